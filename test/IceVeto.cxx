@@ -49,31 +49,449 @@
 // Information about the actual parameter settings can be found in the event
 // structure itself via the device named "IceVeto".
 //
+// For each veto system an output device "IceVeto-<system>" is stored in the event,
+// with the named slots SLCVeto, AmpVetoMin, NdomVetoMin, NhitVetoMin, QtotVetoMin,
+// TresVetoMin, TresVetoMax, NdomVeto, NhitVeto, QtotVeto and VetoLevel (in this order).
+// Only when the observables may represent lower bounds, i.e. for the decision-only
+// evaluation (see SetDecisionOnly) or the "any veto" policy (see SetAnyVeto),
+// the slot "LowerBound" is appended. So, with the default settings the layout of
+// the output devices is the same as before.
+//
+// Class version 2 of IceVeto contains, next to the veto system definitions,
+// the persistent evaluation settings fFused, fRecord, fVerbose, fDecision, fAnyVeto,
+// fRegion, fRegionMin, fGateQtot, fGateNdom, fGateClass and fInstrument.
+// An IceVeto object of class version 1 is read via the ROOT automatic schema evolution,
+// in which case these settings obtain the default values of the constructor.
+// All the compiled data (e.g. the veto DOM masks) are transient, and are rebuilt
+// automatically after reading (see CheckMasks).
+//
 //--- Author: Nick van Eijndhoven 30-jun-2016 IIHE-VUB, Brussel
 //- Modified: NvE $Date$ IIHE-VUB
 ///////////////////////////////////////////////////////////////////////////
  
 #include "IceVeto.h"
 #include "Riostream.h"
+#include "RVersion.h"
+#include "TBranch.h"
+#include "TChain.h"
+#include "TChainElement.h"
+#include "TFile.h"
+#include "THashList.h"
+#include "TROOT.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <bitset>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+#include "ROOT/TTreeProcessorMT.hxx"
+#include "TTreeReader.h"
+#include "TTreeReaderValue.h"
+#endif
 
 ClassImp(IceVeto) // Class implementation to enable ROOT I/O
+ClassImp(IceVetoStream) // Class implementation to enable ROOT I/O
+
+template<class T> class IceVetoQueue // Bounded queue to pass objects between the stages of ProcessPipeline
+{
+ public :
+  IceVetoQueue(size_t depth) { fDepth=depth; }
+  void Push(T item) // Add an item, waiting as long as the queue is full
+  {
+   std::unique_lock<std::mutex> lock(fMutex);
+   fNotFull.wait(lock,[this]{ return fItems.size()<fDepth; });
+   fItems.push_back(item);
+   fNotEmpty.notify_one();
+  }
+  T Pop() // Remove the oldest item, waiting as long as the queue is empty
+  {
+   std::unique_lock<std::mutex> lock(fMutex);
+   fNotEmpty.wait(lock,[this]{ return !fItems.empty(); });
+   T item=fItems.front();
+   fItems.pop_front();
+   fNotFull.notify_one();
+   return item;
+  }
+
+ protected :
+  std::deque<T> fItems;             // The queued items
+  size_t fDepth;                    // The maximum number of queued items
+  std::mutex fMutex;                // Protection of the queued items
+  std::condition_variable fNotFull;  // Signal that an item was removed
+  std::condition_variable fNotEmpty; // Signal that an item was added
+};
+
+static inline Double_t IceVetoClock() // The time (in ns) of the steady clock
+{
+ return std::chrono::duration<Double_t,std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline Double_t IceVetoLap(IceVetoStats& stats,Double_t tlast) // Add the time since "tlast" to "stats"
+{
+ Double_t t=IceVetoClock();
+ stats.fTime+=t-tlast;
+ return t;
+}
+
+static inline void IceVetoAddStats(IceVetoStats& out,const IceVetoStats& in) // Add the statistics "in" to "out"
+{
+ out.fEvents+=in.fEvents;
+ out.fTime+=in.fTime;
+ out.fDoms+=in.fDoms;
+ out.fHits+=in.fHits;
+ out.fRejSLC+=in.fRejSLC;
+ out.fRejAmp+=in.fRejAmp;
+ out.fRejTres+=in.fRejTres;
+ out.fVetoHits+=in.fVetoHits;
+ out.fEarly+=in.fEarly;
+ out.fRegions+=in.fRegions;
+}
+
+static void* IceVetoGetAddress(TChain* data,TBranch*** ptr) // The address of the "IceEvent" branch of "data" as set by the caller
+{
+ *ptr=0;
+ TList* status=data->GetStatus();
+ TChainElement* element=0;
+ if (status) element=(TChainElement*)status->FindObject("IceEvent");
+ if (!element) return 0;
+ *ptr=element->GetBranchPtr();
+ return element->GetBaddress();
+}
+
+static void IceVetoSetAddress(TChain* data,void* address,TBranch** ptr) // Restore the "IceEvent" branch address of "data"
+{
+ if (address)
+ {
+  data->SetBranchAddress("IceEvent",address,ptr);
+  return;
+ }
+
+ TBranch* branch=data->GetBranch("IceEvent");
+ if (branch) data->ResetBranchAddress(branch);
+ TList* status=data->GetStatus();
+ TChainElement* element=0;
+ if (status) element=(TChainElement*)status->FindObject("IceEvent");
+ if (element) element->SetBaddress(0);
+}
+
+static std::atomic<Long64_t> gIceVetoSerial(0); // Counter to provide the unique identifiers of the IceVeto objects
+
+struct IceVetoPool // Registration of the per-thread work spaces of an IceVeto object
+{
+ std::vector<IceVetoScratch*> fScratches; // The per-thread work spaces
+ std::vector<std::thread::id> fIds;      // The thread IDs of the per-thread work spaces
+ std::mutex fMutex;                      // Protection of the per-thread work space registration
+};
+
+static std::mutex gIceVetoLiveMutex; // Protection of the registration of the IceVeto objects with per-thread work spaces
+static std::map<Long64_t,const IceVeto*> gIceVetoLive; // The IceVeto objects with per-thread work spaces, keyed by their serial number
+
+struct IceVetoThreadScratches // The per-thread work spaces of the current thread, which are released when the thread exits
+{
+ std::vector<Long64_t> fSerials;          // The serial numbers of the owning IceVeto objects
+ std::vector<IceVetoScratch*> fScratches; // The per-thread work spaces
+
+ ~IceVetoThreadScratches()
+ {
+  std::lock_guard<std::mutex> live(gIceVetoLiveMutex);
+  for (Int_t i=0; i<Int_t(fScratches.size()); i++)
+  {
+   std::map<Long64_t,const IceVeto*>::iterator it=gIceVetoLive.find(fSerials[i]);
+   if (it==gIceVetoLive.end()) continue;
+   const IceVeto* veto=it->second;
+
+   // Remove the registration of the work space, after which it is released like a private work space
+   Int_t found=0;
+   {
+    std::lock_guard<std::mutex> lock(veto->fPool->fMutex);
+    for (Int_t j=0; j<Int_t(veto->fPool->fScratches.size()); j++)
+    {
+     if (veto->fPool->fScratches[j]!=fScratches[i]) continue;
+     veto->fPool->fScratches.erase(veto->fPool->fScratches.begin()+j);
+     veto->fPool->fIds.erase(veto->fPool->fIds.begin()+j);
+     found=1;
+     break;
+    }
+   }
+   if (found) veto->ReleaseScratch(fScratches[i]);
+  }
+ }
+};
+
+static const Long64_t gIceVetoMaskId=0x49636556654d736bLL; // Identifier of the veto DOM mask cache files
+static const Int_t gIceVetoMaskNhdr=5; // Number of header words of the veto DOM mask cache files
+
+static void IceVetoMaskHeader(const struct stat& src,Long64_t* hdr) // The header of a veto DOM mask cache file
+{
+ hdr[0]=gIceVetoMaskId;
+ hdr[1]=IceVeto::kNwords;
+ hdr[2]=Long64_t(src.st_size);
+ hdr[3]=Long64_t(src.st_mtime);
+#if defined(__APPLE__)
+ hdr[4]=Long64_t(src.st_mtimespec.tv_nsec);
+#elif defined(_WIN32)
+ hdr[4]=0;
+#else
+ hdr[4]=Long64_t(src.st_mtim.tv_nsec);
+#endif
+}
+
+// The DOM ranges of the pre-defined IC86 veto systems (see ActivateVetoSystem).
+// Each entry specifies the veto systems (as a bit pattern) to which the DOMs with numbers
+// [ldom,udom] of the strings [lstring,ustring] are added (add=1) or from which they are removed (add=0).
+// The entries are applied in the listed order.
+struct IceVetoRange
+{
+ Int_t fSys;     // Bit pattern of the pre-defined veto systems to which this entry applies
+ Int_t fLstring; // The lower bound of the string number
+ Int_t fUstring; // The upper bound of the string number
+ Int_t fLdom;    // The lower bound of the DOM number
+ Int_t fUdom;    // The upper bound of the DOM number
+ Int_t fAdd;     // Flag to add (1) or remove (0) the DOMs
+};
+
+enum {kIceTop=1<<0,kUpper=1<<1,kDustLayer=1<<2,kBottom=1<<3,kSides=1<<4,kStart=1<<5,kHESE=1<<6};
+static const Int_t gIceVetoNbuiltin=7;
+static const char* gIceVetoBuiltinNames[gIceVetoNbuiltin]={"IceTop86","Upper86","DustLayer86","Bottom86","Sides86","Start86","HESE86"};
+
+static constexpr IceVetoRange gIceVetoRanges[]=
+{
+ // All IceTop DOMs
+ {kIceTop,1,86,61,64,1},
+ // The top 6 IC DOMs
+ {kUpper|kStart|kHESE,1,79,1,6,1},
+ // The bottom DOM of each IC string
+ {kBottom|kStart|kHESE,1,79,60,60,1},
+ // All IC DOMs in the dust layer
+ {kDustLayer|kStart|kHESE,1,79,39,43,1},
+ // All DOMs on the IC86 outer strings
+ {kSides|kStart|kHESE,1,7,1,60,1},
+ {kSides|kStart|kHESE,13,14,1,60,1},
+ {kSides|kStart|kHESE,21,22,1,60,1},
+ {kSides|kStart|kHESE,30,31,1,60,1},
+ {kSides|kStart|kHESE,40,41,1,60,1},
+ {kSides|kStart|kHESE,50,51,1,60,1},
+ {kSides|kStart|kHESE,59,60,1,60,1},
+ {kSides|kStart|kHESE,67,68,1,60,1},
+ {kSides|kStart|kHESE,72,78,1,60,1},
+ // The modifications for "HESE86" w.r.t. "Start86"
+ {kHESE,8,8,43,43,0},
+ {kHESE,10,10,43,43,0},
+ {kHESE,11,11,43,43,0},
+ {kHESE,12,12,43,43,0},
+ {kHESE,15,15,7,7,1},
+ {kHESE,15,15,60,60,0},
+ {kHESE,16,16,43,43,0},
+ {kHESE,18,18,43,43,0},
+ {kHESE,19,19,43,43,0},
+ {kHESE,20,20,43,43,0},
+ {kHESE,24,24,60,60,0},
+ {kHESE,25,25,60,60,0},
+ {kHESE,26,26,43,43,0},
+ {kHESE,27,27,38,38,1},
+ {kHESE,27,27,43,43,0},
+ {kHESE,28,28,43,43,0},
+ {kHESE,29,29,60,60,0},
+ {kHESE,34,34,7,8,1},
+ {kHESE,34,34,39,39,0},
+ {kHESE,34,34,44,44,1},
+ {kHESE,34,34,60,60,0},
+ {kHESE,35,35,60,60,0},
+ {kHESE,37,37,7,7,1},
+ {kHESE,37,37,60,60,0},
+ {kHESE,38,38,38,38,1},
+ {kHESE,38,38,43,43,0},
+ {kHESE,39,39,60,60,0},
+ {kHESE,42,42,60,60,0},
+ {kHESE,45,45,43,43,0},
+ {kHESE,46,46,60,60,0},
+ {kHESE,47,47,60,60,0},
+ {kHESE,49,49,7,7,1},
+ {kHESE,49,49,60,60,0},
+ {kHESE,52,52,43,43,0},
+ {kHESE,55,55,60,60,0},
+ {kHESE,56,56,60,60,0},
+ {kHESE,57,57,7,7,1},
+ {kHESE,57,57,60,60,0},
+ {kHESE,58,58,43,43,0},
+ {kHESE,63,63,43,43,0},
+ {kHESE,64,64,7,8,1},
+ {kHESE,64,64,39,39,0},
+ {kHESE,64,64,44,44,1},
+ {kHESE,64,64,60,60,0},
+ {kHESE,65,65,7,7,1},
+ {kHESE,65,65,39,39,0},
+ {kHESE,65,65,60,60,0},
+ {kHESE,66,66,7,7,1},
+ {kHESE,66,66,39,39,0},
+ {kHESE,66,66,60,60,0},
+ {kHESE,71,71,43,43,0},
+ // The DeepCore string 79 is not part of the "HESE86" top, bottom and dust layer veto DOMs
+ {kHESE,79,79,1,6,0},
+ {kHESE,79,79,39,43,0},
+ {kHESE,79,79,60,60,0},
+ // The "HESE86" DeepCore veto cap
+ {kHESE,79,86,11,18,1},
+ {kHESE,81,81,19,19,1},
+ {kHESE,85,86,19,19,1}
+};
+static constexpr Int_t gIceVetoNranges=sizeof(gIceVetoRanges)/sizeof(IceVetoRange);
+
+// Compile time construction of the veto DOM mask word of string "js" for the pre-defined veto system "isys"
+static constexpr ULong64_t IceVetoDOMBits(Int_t ldom,Int_t udom)
+{
+ return (udom<ldom) ? 0 : ((~ULong64_t(0))>>(63-(udom-ldom)))<<(ldom-1);
+}
+static constexpr ULong64_t IceVetoApply(const IceVetoRange& r,Int_t isys,Int_t js,ULong64_t word)
+{
+ return (!((r.fSys>>isys)&1) || js<r.fLstring || js>r.fUstring) ? word :
+        (r.fAdd ? (word|IceVetoDOMBits(r.fLdom,r.fUdom)) : (word&~IceVetoDOMBits(r.fLdom,r.fUdom)));
+}
+static constexpr ULong64_t IceVetoWord(Int_t isys,Int_t js,Int_t n)
+{
+ return (n>0) ? IceVetoApply(gIceVetoRanges[n-1],isys,js,IceVetoWord(isys,js,n-1)) : 0;
+}
+
+#define ICEVETO_W1(k,s) IceVetoWord(k,s,gIceVetoNranges)
+#define ICEVETO_W2(k,s) ICEVETO_W1(k,s),ICEVETO_W1(k,s+1)
+#define ICEVETO_W4(k,s) ICEVETO_W2(k,s),ICEVETO_W2(k,s+2)
+#define ICEVETO_W8(k,s) ICEVETO_W4(k,s),ICEVETO_W4(k,s+4)
+#define ICEVETO_W16(k,s) ICEVETO_W8(k,s),ICEVETO_W8(k,s+8)
+#define ICEVETO_W32(k,s) ICEVETO_W16(k,s),ICEVETO_W16(k,s+16)
+#define ICEVETO_W64(k,s) ICEVETO_W32(k,s),ICEVETO_W32(k,s+32)
+#define ICEVETO_MASK(k) {ICEVETO_W1(k,0),ICEVETO_W64(k,1),ICEVETO_W16(k,65),ICEVETO_W4(k,81),ICEVETO_W2(k,85)}
+
+// The compiled veto DOM masks of the pre-defined veto systems for the strings 0-86
+static constexpr ULong64_t gIceVetoBuiltin[gIceVetoNbuiltin][87]=
+{
+ ICEVETO_MASK(0),ICEVETO_MASK(1),ICEVETO_MASK(2),ICEVETO_MASK(3),ICEVETO_MASK(4),ICEVETO_MASK(5),ICEVETO_MASK(6)
+};
 
 IceVeto::IceVeto(const char* name,const char* title) : TTask(name,title)
 {
 // Default constructor.
 
  fVetos=0;
+ fFused=0;
+ fRecord=kRecordRef;
+ fVerbose=0;
+ fDecision=0;
+ fAnyVeto=0;
+ fRegion=0;
+ fRegionMin=64;
+ fGateQtot=0;
+ fGateNdom=0;
+ fGateClass="IceIDOM";
+ fInstrument=0;
+
+ // The light speed in m/ns
+ NcAstrolab lab;
+ fSpeedC=lab.GetPhysicalParameter("SpeedC")*1.e-9;
+
+ // The work space for Exec() is only created at the first event (see GetExecScratch),
+ // so that no work space is allocated for objects that are only used for I/O
+ fSerial=++gIceVetoSerial;
+ fScratch=0;
+ fResult.fVetoLevel=0;
+ fResult.fGated=0;
+ fResult.fGateQtot=0;
+ fResult.fGateNdom=0;
+ fPool=new IceVetoPool();
+ fRegistry=new THashList();
+
+ for (Int_t iw=0; iw<kNwords; iw++)
+ {
+  fAnyMask[iw]=0;
+ }
+
+ // The template for the output devices with the slot indices resolved once.
+ // The "LowerBound" slot is not part of the template, but is appended to the
+ // prototypes only when needed (see UpdatePrototypes).
+ const char* slotnames[kNslots]={"SLCVeto","AmpVetoMin","NdomVetoMin","NhitVetoMin","QtotVetoMin","TresVetoMin","TresVetoMax",
+                                 "NdomVeto","NhitVeto","QtotVeto","VetoLevel","LowerBound"};
+ fOutput.SetHitCopy(0);
+ for (Int_t i=0; i<kLowerBound; i++)
+ {
+  fOutput.AddNamedSlot(slotnames[i]);
+ }
+ for (Int_t i=0; i<kLowerBound; i++)
+ {
+  fSlots[i]=fOutput.GetSlotIndex(slotnames[i]);
+ }
+ NcVeto bound(fOutput);
+ bound.AddNamedSlot(slotnames[kLowerBound]);
+ fSlots[kLowerBound]=bound.GetSlotIndex(slotnames[kLowerBound]);
+
+ fProtos.SetOwner();
+
+ // The output device for the events that failed the pre-veto gate (see StoreGate)
+ TString gname=GetName();
+ gname+="-Gate";
+ fGate.SetNameTitle(gname.Data(),"Pre-veto gate");
+ fGate.SetHitCopy(0);
+ fGate.AddNamedSlot("Gated");
+ fGate.AddNamedSlot("QtotGate");
+ fGate.AddNamedSlot("NdomGate");
+
+ fTree=0;
+ fTreeRun=0;
+ fTreeEvent=0;
+ fTreeLevel=0;
+
+ fScanEvents=0;
 }
 ///////////////////////////////////////////////////////////////////////////
 IceVeto::~IceVeto()
 {
 // Default destructor.
 
+ if (fRegistry)
+ {
+  delete fRegistry;
+  fRegistry=0;
+ }
+
  if (fVetos)
  {
   delete fVetos;
   fVetos=0;
  }
+
+ if (fScratch)
+ {
+  delete fScratch;
+  fScratch=0;
+ }
+
+ // Deregister this object, after which its per-thread work spaces are not released anymore at thread exit
+ {
+  std::lock_guard<std::mutex> lock(gIceVetoLiveMutex);
+  gIceVetoLive.erase(fSerial);
+ }
+
+ if (fPool)
+ {
+  for (Int_t i=0; i<Int_t(fPool->fScratches.size()); i++)
+  {
+   if (fPool->fScratches[i]) delete fPool->fScratches[i];
+  }
+  delete fPool;
+  fPool=0;
+ }
 }
 ///////////////////////////////////////////////////////////////////////////
 void IceVeto::DefineVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndom,Int_t nhit,Int_t slc,Float_t tresmin,Float_t tresmax)
@@ -107,19 +525,15 @@ void IceVeto::DefineVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndom,
   fVetos->SetOwner();
  }
 
- Int_t nvetos=fVetos->GetEntries();
- for (Int_t i=0; i<nvetos; i++)
+ if (GetVetoIndex(name)>=0)
  {
-  TObject* obj=fVetos->At(i);
-  if (!obj) continue;
-  if (name==obj->GetName())
-  {
-   cout << " *IceVeto::DefineVetoSystem* Name already exists : " << name.Data() << endl;
-   cout << " Please specify another (unique) name for the veto system." << endl;
-   return;
-  }
+  cout << " *IceVeto::DefineVetoSystem* Name already exists : " << name.Data() << endl;
+  cout << " Please specify another (unique) name for the veto system." << endl;
+  return;
  }
 
+ Int_t nvetos=fVetos->GetEntries();
+
  if (ndom<=0) ndom=1;
  if (nhit<=0) nhit=1;
  if (slc) slc=1;
@@ -146,6 +560,19 @@ void IceVeto::DefineVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndom,
  dveto->SetSignal(tresmax,"TresVetoMax");
 
  fVetos->Add(dveto);
+ fRegistry->Add(dveto);
+
+ // Provide the compiled parameters and an (empty) compiled veto DOM mask for this veto system
+ if (Int_t(fMasks.size())==nvetos*kNwords && Int_t(fConfigs.size())==nvetos)
+ {
+  fMasks.resize((nvetos+1)*kNwords,0);
+  fConfigs.resize(nvetos+1);
+  LoadConfig(nvetos);
+ }
+ else
+ {
+  CompileVetoSystems();
+ }
 }
 ///////////////////////////////////////////////////////////////////////////
 void IceVeto::AddVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,Int_t udom)
@@ -177,20 +604,11 @@ void IceVeto::AddVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,In
   return;
  }
 
+ Int_t isys=GetVetoIndex(name);
  NcVeto* dveto=0;
- Int_t ifound=0;
- for (Int_t i=0; i<fVetos->GetEntries(); i++)
- {
-  dveto=(NcVeto*)fVetos->At(i);
-  if (!dveto) continue;
-  if (name==dveto->GetName())
-  {
-   ifound=1;
-   break;
-  }
- }
+ if (isys>=0) dveto=(NcVeto*)fVetos->At(isys);
 
- if (!ifound)
+ if (!dveto)
  {
   cout << " *IceVeto::AddVetoDOMs* No veto system found with name : " << name.Data() << endl;
   return;
@@ -202,7 +620,10 @@ void IceVeto::AddVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,In
 
  if (nadd<1) return;
 
+ CheckMasks();
+
  Int_t idom=0;
+ Int_t index=0;
  NcSignal vdom;
  for (Int_t js=lstring; js<=ustring; js++)
  {
@@ -212,19 +633,31 @@ void IceVeto::AddVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,In
    if (js<0) idom=-idom;
 
    // Check if this DOM was already registered for this veto system
-   NcSignal* sx=dveto->GetIdHit(idom);
-   if (!sx)
+   index=GetDOMIndex(idom);
+   if (index>=0)
+   {
+    if (IsVetoDOM(isys,index)) continue;
+   }
+   else
    {
-    vdom.SetUniqueID(idom);
-    dveto->AddHit(vdom);
+    if (dveto->GetIdHit(idom)) continue;
    }
+
+   vdom.SetUniqueID(idom);
+   dveto->AddHit(vdom);
+   if (index>=0) SetVetoDOM(isys,index,1);
   }
  }
 
+ UpdateAnyMask();
+
  // Remove "Pre-defined" from the veto system title in case this affected a pre-defined veto system.
  TString title=dveto->GetTitle();
  title.ReplaceAll("Pre-defined ","");
  dveto->SetTitle(title.Data()); 
+
+ // Update the compiled form of this veto system
+ LoadConfig(isys);
 }
 ///////////////////////////////////////////////////////////////////////////
 void IceVeto::RemoveVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,Int_t udom)
@@ -256,20 +689,11 @@ void IceVeto::RemoveVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom
   return;
  }
 
+ Int_t isys=GetVetoIndex(name);
  NcVeto* dveto=0;
- Int_t ifound=0;
- for (Int_t i=0; i<fVetos->GetEntries(); i++)
- {
-  dveto=(NcVeto*)fVetos->At(i);
-  if (!dveto) continue;
-  if (name==dveto->GetName())
-  {
-   ifound=1;
-   break;
-  }
- }
+ if (isys>=0) dveto=(NcVeto*)fVetos->At(isys);
 
- if (!ifound)
+ if (!dveto)
  {
   cout << " *IceVeto::RemoveVetoDOMs* No veto system found with name : " << name.Data() << endl;
   return;
@@ -281,7 +705,10 @@ void IceVeto::RemoveVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom
 
  if (nrem<1) return;
 
+ CheckMasks();
+
  Int_t idom=0;
+ Int_t index=0;
  for (Int_t js=lstring; js<=ustring; js++)
  {
   for (Int_t jd=ldom; jd<=udom; jd++)
@@ -289,23 +716,145 @@ void IceVeto::RemoveVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom
    idom=100*abs(js)+jd;
    if (js<0) idom=-idom;
 
+   // Only DOMs which are registered in the compiled mask need to be searched for
+   index=GetDOMIndex(idom);
+   if (index>=0 && !IsVetoDOM(isys,index)) continue;
+
    // Remove the corresponding DOM from this veto system (if present)
    NcSignal* sx=dveto->GetIdHit(idom);
    if (sx) dveto->RemoveHit(sx);
+   if (index>=0) SetVetoDOM(isys,index,0);
+  }
+ }
+
+ UpdateAnyMask();
+
+ // Remove "Pre-defined" from the veto system title in case this affected a pre-defined veto system.
+ TString title=dveto->GetTitle();
+ title.ReplaceAll("Pre-defined ","");
+ dveto->SetTitle(title.Data()); 
+
+ // Update the compiled form of this veto system
+ LoadConfig(isys);
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::LoadVetoDOMs(TString name,TString file,TString cache)
+{
+// Add the veto DOMs listed in the text file "file" to the (already defined) veto system "name".
+// The file should contain the veto DOMs as "(string, dom)" entries, like e.g.
+//
+// (1, 1)
+// (1, 2)
+//
+// as in the file HESE-veto-DOMs.txt of the IceVeto test directory.
+// Any other characters in between the entries are ignored.
+//
+// The file is read by a streaming parser, which directly sets the corresponding bits
+// in a compiled veto DOM mask, after which all the new DOMs are added to the veto system
+// in a single pass (see AddVetoMask), without repeated searches over the veto DOMs
+// already present in the veto system.
+//
+// The obtained veto DOM mask is written into a small binary cache file "cache".
+// For subsequent invokations with the same "file", the mask is obtained (memory mapped)
+// from this cache file, provided the size and modification time of "file" are
+// unchanged, which avoids the parsing of the text file.
+// The modification time is compared including its sub-second part, as far as provided
+// by the file system, so that also quick successive edits of "file" are recognised.
+// By default (cache="") the cache file name is the name of "file" extended with ".vmask".
+// In case "cache" specifies an existing directory, the cache file is created in that
+// directory, with the name of "file" (without its path) extended with ".vmask".
+// This allows the use of a cache for files residing in a read-only directory.
+// In case the cache file can't be created (e.g. due to a read-only directory) the
+// text file is just parsed at each invokation, and a message is only printed
+// for a verbosity level (see SetVerbose) of at least 1.
+// Specification of cache="none" will disable the use of a cache file.
+//
+// The return argument is the number of veto DOMs that were added to the veto system.
+
+ if (!fVetos)
+ {
+  cout << " *IceVeto::LoadVetoDOMs* No veto systems have been defined." << endl;
+  return 0;
+ }
+
+ Int_t isys=GetVetoIndex(name);
+ NcVeto* dveto=0;
+ if (isys>=0) dveto=(NcVeto*)fVetos->At(isys);
+
+ if (!dveto)
+ {
+  cout << " *IceVeto::LoadVetoDOMs* No veto system found with name : " << name.Data() << endl;
+  return 0;
+ }
+
+ if (cache=="")
+ {
+  cache=file+".vmask";
+ }
+ else if (cache!="none")
+ {
+  // Provide the cache file name in case a cache directory was specified
+  struct stat cdir;
+  if (!stat(cache.Data(),&cdir) && (cdir.st_mode & S_IFMT)==S_IFDIR)
+  {
+   TString base=file;
+   Int_t slash=base.Last('/');
+   if (slash>=0) base=base(slash+1,base.Length()-slash-1);
+   if (!cache.EndsWith("/")) cache+="/";
+   cache+=base;
+   cache+=".vmask";
   }
  }
 
+ CheckMasks();
+
+ ULong64_t mask[kNwords];
+ std::vector<Int_t> extra;
+ Int_t ok=0;
+ if (cache!="none") ok=ReadMaskCache(cache,file,mask);
+ if (!ok)
+ {
+  ok=ParseVetoDOMs(file,mask,extra);
+  if (!ok)
+  {
+   cout << " *IceVeto::LoadVetoDOMs* File could not be read : " << file.Data() << endl;
+   return 0;
+  }
+
+  // The DOMs outside the range of the DOM lookup table can't be cached
+  if (cache!="none" && !extra.size()) WriteMaskCache(cache,file,mask);
+ }
+
+ Int_t nadd=AddVetoMask(isys,mask);
+
+ // Register the DOMs outside the range of the DOM lookup table individually
+ NcSignal vdom;
+ for (Int_t i=0; i<Int_t(extra.size()); i++)
+ {
+  if (dveto->GetIdHit(extra[i])) continue;
+  vdom.SetUniqueID(extra[i]);
+  dveto->AddHit(vdom);
+  nadd++;
+ }
+
+ UpdateAnyMask();
+
  // Remove "Pre-defined" from the veto system title in case this affected a pre-defined veto system.
  TString title=dveto->GetTitle();
  title.ReplaceAll("Pre-defined ","");
  dveto->SetTitle(title.Data()); 
+
+ // Update the compiled form of this veto system
+ LoadConfig(isys);
+
+ return nadd;
 }
 ///////////////////////////////////////////////////////////////////////////
 void IceVeto::ActivateVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndom,Int_t nhit,Int_t slc,Float_t tresmin,Float_t tresmax)
 {
 // Activate a pre-defined a veto system.
-// This facility automatically invokes the corresponding memberfunctions DefineVetoSystem() and AddVetoDOMs()
-// for the specified veto system. 
+// This facility automatically invokes the memberfunction DefineVetoSystem() for the specified veto system,
+// after which the veto DOMs are registered from a compile time constant veto DOM mask (see CheckBuiltinMasks).
 // The various parameters will be stored in an NcDevice with the specified name.
 //
 // Input arguments :
@@ -346,18 +895,37 @@ void IceVeto::ActivateVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndo
 // "HESE86"       : The veto system that was used for the IC86 HESE events
 // "Start86"      : Veto system to select events starting in the IC86 InIce detector
 //                  This comprises the veto systems "Upper86", "DustLayer86", "Bottom86" and "Sides86"
+//
+// The veto DOMs of the pre-defined veto systems are defined by the DOM ranges in gIceVetoRanges.
+// The "HESE86" veto DOMs agree with the list in the file HESE-veto-DOMs.txt of the IceVeto
+// test directory, which is verified by CheckBuiltinMasks() via the macro check.cc.
+// Note that, in comparison with the previous versions of this class, this implies that the "HESE86"
+// veto system also contains DOM (15,7) and the DeepCore veto cap DOMs 11-18 (11-19 for the
+// strings 81, 85 and 86) of the strings 79-86, whereas the DOMs 1-6, 39-43 and 60 of the
+// DeepCore string 79 are not part of it anymore.
 
- if (name!="IceTop86" && name!="Upper86" && name!="DustLayer86" && name!="Bottom86" && name!="Sides86"
-     && name!="HESE86" && name!="Start86")
+ Int_t ibuiltin=-1;
+ for (Int_t i=0; i<gIceVetoNbuiltin; i++)
+ {
+  if (name==gIceVetoBuiltinNames[i])
+  {
+   ibuiltin=i;
+   break;
+  }
+ }
+
+ if (ibuiltin<0)
  {
   cout << " *IceVeto::ActivateVetoSystem* Unknown pre-defined veto system : " << name.Data() << endl;
   return;
  }
 
+ Int_t sys=1<<ibuiltin;
+
  if (qtot<0)
  {
   qtot=0;
-  if (name=="HESE86") qtot=3;
+  if (sys==kHESE) qtot=3;
  }
  if (amp<0)
  {
@@ -366,7 +934,7 @@ void IceVeto::ActivateVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndo
  if (ndom<0)
  {
   ndom=1;
-  if (name=="HESE86") ndom=3;
+  if (sys==kHESE) ndom=3;
  }
  if (nhit<0)
  {
@@ -375,7 +943,7 @@ void IceVeto::ActivateVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndo
  if (slc<0)
  {
   slc=1;
-  if (name=="HESE86" || name=="IceTop86") slc=0;
+  if (sys==kHESE || sys==kIceTop) slc=0;
  }
  if (tresmin==tresmax)
  {
@@ -385,106 +953,137 @@ void IceVeto::ActivateVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndo
 
  DefineVetoSystem(name,qtot,amp,ndom,nhit,slc,tresmin,tresmax);
 
- if (name=="IceTop86")
- {
- // Mark all IceTOP DOMs as veto
-  AddVetoDOMs(name,1,86,61,64);
- }
-
- if (name=="Upper86" || name=="Start86" || name=="HESE86")
- {
-  // Mark the top 6 IC DOMs as veto 
-  AddVetoDOMs(name,1,79,1,6);
- }
-
- if (name=="Bottom86" || name=="Start86" || name=="HESE86")
- {
-  // Mark the bottom DOM of each IC string as veto 
-  AddVetoDOMs(name,1,79,60,60);
- }
-
- if (name=="DustLayer86" || name=="Start86" || name=="HESE86")
- {
-  // Mark all IC DOMs in the dust layer as veto 
-  AddVetoDOMs(name,1,79,39,43);
- }
-
- if (name=="Sides86" || name=="Start86" || name=="HESE86")
- {
-  // Mark all DOMs on the IC86 outer strings as veto
-  AddVetoDOMs(name,1,7,1,60);
-  AddVetoDOMs(name,13,14,1,60);
-  AddVetoDOMs(name,21,22,1,60);
-  AddVetoDOMs(name,30,31,1,60);
-  AddVetoDOMs(name,40,41,1,60);
-  AddVetoDOMs(name,50,51,1,60);
-  AddVetoDOMs(name,59,60,1,60);
-  AddVetoDOMs(name,67,68,1,60);
-  AddVetoDOMs(name,72,78,1,60);
- }
-
- if (name=="HESE86") // Change some configurations for "HESE86" w.r.t. "Start86"
- {
-  RemoveVetoDOMs(name,8,8,43,43);  
-  RemoveVetoDOMs(name,10,10,43,43);  
-  RemoveVetoDOMs(name,11,11,43,43);  
-  RemoveVetoDOMs(name,12,12,43,43);  
-  RemoveVetoDOMs(name,15,15,60,60);  
-  RemoveVetoDOMs(name,16,16,43,43);  
-  RemoveVetoDOMs(name,18,18,43,43);  
-  RemoveVetoDOMs(name,19,19,43,43);  
-  RemoveVetoDOMs(name,20,20,43,43);  
-  RemoveVetoDOMs(name,24,24,60,60);  
-  RemoveVetoDOMs(name,25,25,60,60);  
-  RemoveVetoDOMs(name,26,26,43,43);  
-  AddVetoDOMs(name,27,27,38,38);  
-  RemoveVetoDOMs(name,27,27,43,43);  
-  RemoveVetoDOMs(name,28,28,43,43);  
-  RemoveVetoDOMs(name,29,29,60,60);  
-  AddVetoDOMs(name,34,34,7,8);  
-  RemoveVetoDOMs(name,34,34,39,39);  
-  AddVetoDOMs(name,34,34,44,44);  
-  RemoveVetoDOMs(name,34,34,60,60);  
-  RemoveVetoDOMs(name,35,35,60,60);  
-  AddVetoDOMs(name,37,37,7,7);  
-  RemoveVetoDOMs(name,37,37,60,60);  
-  AddVetoDOMs(name,38,38,38,38);  
-  RemoveVetoDOMs(name,38,38,43,43);  
-  RemoveVetoDOMs(name,39,39,60,60);  
-  RemoveVetoDOMs(name,42,42,60,60);  
-  RemoveVetoDOMs(name,45,45,43,43);  
-  RemoveVetoDOMs(name,46,46,60,60);  
-  RemoveVetoDOMs(name,47,47,60,60);  
-  AddVetoDOMs(name,49,49,7,7);  
-  RemoveVetoDOMs(name,49,49,60,60);  
-  RemoveVetoDOMs(name,52,52,43,43);  
-  RemoveVetoDOMs(name,55,55,60,60);  
-  RemoveVetoDOMs(name,56,56,60,60);  
-  AddVetoDOMs(name,57,57,7,7);  
-  RemoveVetoDOMs(name,57,57,60,60);  
-  RemoveVetoDOMs(name,58,58,43,43);  
-  RemoveVetoDOMs(name,63,63,43,43);  
-  AddVetoDOMs(name,64,64,7,8);  
-  RemoveVetoDOMs(name,64,64,39,39);  
-  AddVetoDOMs(name,64,64,44,44);  
-  RemoveVetoDOMs(name,64,64,60,60);  
-  AddVetoDOMs(name,65,65,7,7);  
-  RemoveVetoDOMs(name,65,65,39,39);  
-  RemoveVetoDOMs(name,65,65,60,60);  
-  AddVetoDOMs(name,66,66,7,7);  
-  RemoveVetoDOMs(name,66,66,39,39);  
-  RemoveVetoDOMs(name,66,66,60,60);  
-  RemoveVetoDOMs(name,71,71,43,43);  
- }
+ // Mark the veto DOMs by means of the compile time veto DOM mask of this pre-defined veto system.
+ // The DOM ranges of the various pre-defined veto systems are listed in gIceVetoRanges.
+ Int_t isys=GetVetoIndex(name);
+ if (isys<0) return;
+
+ NcVeto* dveto=(NcVeto*)fVetos->At(isys);
+
+ CheckMasks();
+
+ ULong64_t mask[kNwords];
+ GetBuiltinMask(ibuiltin,mask);
+ AddVetoMask(isys,mask);
+ UpdateAnyMask();
 
  // Indicate in the veto system title that this is a pre-defined one.
  TString title="Pre-defined ";
- NcVeto* dveto=GetVetoSystem(name);
- if (dveto)
+ title+=dveto->GetTitle();
+ dveto->SetTitle(title.Data());
+
+ // Update the compiled form of this veto system
+ LoadConfig(isys);
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::GetBuiltinMask(Int_t ibuiltin,ULong64_t* mask) const
+{
+// Provide the compiled veto DOM mask of the pre-defined veto system with index "ibuiltin"
+// in the list gIceVetoBuiltinNames.
+// The mask is a copy of the corresponding compile time constant mask.
+
+ for (Int_t iw=0; iw<kNwords; iw++)
  {
-  title+=dveto->GetTitle();
-  dveto->SetTitle(title.Data());
- } 
+  mask[iw]=0;
+ }
+
+ if (ibuiltin<0 || ibuiltin>=gIceVetoNbuiltin) return;
+
+ for (Int_t js=0; js<=kMaxString; js++)
+ {
+  mask[js+kMaxString]=gIceVetoBuiltin[ibuiltin][js];
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::CheckBuiltinMasks(TString file)
+{
+// Check the consistency of the compile time veto DOM masks of the pre-defined veto systems.
+// The masks are re-constructed here at run time from the DOM ranges in gIceVetoRanges,
+// and compared with the compile time masks.
+// In addition, the "HESE86" mask is compared with the veto DOMs listed in the text file "file"
+// (see LoadVetoDOMs), like e.g. the file HESE-veto-DOMs.txt of the IceVeto test directory.
+// The DOMs which are only present in one of these two "HESE86" definitions are listed.
+// Specification of file="" will skip the comparison with a text file.
+// For the file HESE-veto-DOMs.txt no differences should be reported, which is verified
+// by the macro check.cc.
+//
+// The return argument is the number of detected differences.
+
+ Int_t ndiff=0;
+
+ ULong64_t mask[kNwords];
+ ULong64_t word=0;
+ ULong64_t bits=0;
+ const IceVetoRange* r=0;
+ for (Int_t ib=0; ib<gIceVetoNbuiltin; ib++)
+ {
+  GetBuiltinMask(ib,mask);
+  for (Int_t js=0; js<=kMaxString; js++)
+  {
+   word=0;
+   for (Int_t ir=0; ir<gIceVetoNranges; ir++)
+   {
+    r=&gIceVetoRanges[ir];
+    if (!((r->fSys>>ib)&1) || js<r->fLstring || js>r->fUstring) continue;
+    for (Int_t jd=r->fLdom; jd<=r->fUdom; jd++)
+    {
+     bits=ULong64_t(1)<<(jd-1);
+     if (r->fAdd)
+     {
+      word|=bits;
+     }
+     else
+     {
+      word&=~bits;
+     }
+    }
+   }
+   if (word!=mask[js+kMaxString])
+   {
+    cout << " *IceVeto::CheckBuiltinMasks* Inconsistent mask for " << gIceVetoBuiltinNames[ib] << " string " << js << endl;
+    ndiff++;
+   }
+  }
+ }
+
+ if (file=="") return ndiff;
+
+ ULong64_t fmask[kNwords];
+ std::vector<Int_t> extra;
+ if (!ParseVetoDOMs(file,fmask,extra))
+ {
+  cout << " *IceVeto::CheckBuiltinMasks* File could not be read : " << file.Data() << endl;
+  return ndiff+1;
+ }
+
+ GetBuiltinMask(gIceVetoNbuiltin-1,mask);
+
+ Int_t js=0;
+ for (Int_t iw=0; iw<kNwords; iw++)
+ {
+  bits=mask[iw]^fmask[iw];
+  if (!bits) continue;
+
+  js=iw-kMaxString;
+  for (Int_t jd=1; jd<=kMaxDOM; jd++)
+  {
+   if (!((bits>>(jd-1))&1)) continue;
+   cout << " *IceVeto::CheckBuiltinMasks* DOM (" << js << ", " << jd << ") only present in ";
+   if ((mask[iw]>>(jd-1))&1)
+   {
+    cout << gIceVetoBuiltinNames[gIceVetoNbuiltin-1] << endl;
+   }
+   else
+   {
+    cout << file.Data() << endl;
+   }
+   ndiff++;
+  }
+ }
+
+ ndiff+=extra.size();
+
+ return ndiff;
 }
 ///////////////////////////////////////////////////////////////////////////
 void IceVeto::SetVetoParameter(TString sname,TString pname,Double_t pval)
@@ -519,18 +1118,17 @@ void IceVeto::SetVetoParameter(TString sname,TString pname,Double_t pval)
  if (pname=="NhitVetoMin" && pval<=0) pval=1;
  if (pname=="SLCVeto" && pval>0.1) pval=1;
 
- NcVeto* dveto=0;
- Int_t nvetos=fVetos->GetEntries();
- for (Int_t i=0; i<nvetos; i++)
- {
-  TObject* obj=fVetos->At(i);
-  if (!obj) continue;
-  if (sname != obj->GetName()) continue;
+ Int_t isys=GetVetoIndex(sname);
+ if (isys<0) return;
 
-  dveto=(NcVeto*)obj;
-  dveto->SetSignal(pval,pname);
-  return;
- }
+ NcVeto* dveto=(NcVeto*)fVetos->At(isys);
+ if (!dveto) return;
+
+ dveto->SetSignal(pval,pname);
+
+ // Update the compiled parameters of this veto system
+ CheckMasks();
+ LoadConfig(isys);
 }
 ///////////////////////////////////////////////////////////////////////////
 void IceVeto::Data(Int_t mode)
@@ -540,6 +1138,7 @@ void IceVeto::Data(Int_t mode)
 // mode = 0 --> Only the ID, name and number of associated veto DOMs of all the registered veto systems is provided
 //        1 --> The same as mode=0 but also the veto system parameters are listed
 //        2 --> The same as mode=1 bit also the IDs of all the veto DOMs are listed
+//        3 --> The same as mode=1 but also the timing and counter statistics are listed (see SetInstrumentation)
 //
 // Default value : mode=0
 
@@ -547,6 +1146,16 @@ void IceVeto::Data(Int_t mode)
  if (fVetos) nvetos=fVetos->GetEntries();
 
  cout << " *IceVeto::Data()* Number of registered veto systems : " << nvetos << endl;
+ if (fGateQtot>0 || fGateNdom>0)
+ {
+  cout << " Pre-veto gate for the " << fGateClass.Data() << " hits : Qtot>=" << fGateQtot << " nDOMs>=" << fGateNdom << endl;
+ }
+ if (fRegion)
+ {
+  cout << " Region summary evaluation for events with at least " << fRegionMin << " fired DOMs";
+  if (fRecord!=kRecordCount) cout << " : Only for veto systems without veto hits, since veto hits are recorded (mode " << fRecord << ")";
+  cout << endl;
+ }
 
  NcVeto* dveto=0;
  TString name;
@@ -576,253 +1185,4101 @@ void IceVeto::Data(Int_t mode)
    dveto->ShowHit();
   }
  }
+
+ if (mode==3) ListStats();
 }
 ///////////////////////////////////////////////////////////////////////////
 NcVeto* IceVeto::GetVetoSystem(TString name)
 {
 // Provide a pointer to the specified veto system.
 //
-// In case of inconsistency a value 0 will be returned.
+// In case the veto system is not present, a value 0 will be returned.
 
- if (!fVetos) return 0;
+ Int_t isys=GetVetoIndex(name);
+ if (isys<0) return 0;
 
- NcVeto* dveto=0;
- for (Int_t i=0; i<fVetos->GetEntries(); i++)
- {
-  dveto=(NcVeto*)fVetos->At(i);
-  if (!dveto) continue;
+ return (NcVeto*)fVetos->At(isys);
+}
+///////////////////////////////////////////////////////////////////////////
+NcVeto* IceVeto::GetVetoSystem(Int_t id)
+{
+// Provide a pointer to the veto system with the specified ID.
+// The ID of a veto system is the (unique) ID of the corresponding NcVeto device,
+// which reflects the order of definition (see GetVetoSystemId).
+//
+// In case the veto system is not present, a value 0 will be returned.
 
-  if (name==dveto->GetName()) break;
- }
+ if (!fVetos || id<1 || id>fVetos->GetEntries()) return 0;
+
+ NcVeto* dveto=(NcVeto*)fVetos->At(id-1);
+ if (dveto && Int_t(dveto->GetUniqueID())!=id) dveto=0;
 
  return dveto;
 }
 ///////////////////////////////////////////////////////////////////////////
-void IceVeto::Exec(Option_t* opt)
+Int_t IceVeto::GetVetoSystemId(TString name)
 {
-// Implementation of the (self)vetoing procedure.
+// Provide the ID of the specified veto system.
+// The veto systems obtain the IDs 1,2,3,... in the order in which they were defined,
+// which allows a fast access via GetVetoSystem(id), e.g. when modifying the
+// parameters of many veto systems.
+//
+// In case the veto system is not present, a value 0 will be returned.
 
- TString name=opt;
- NcJob* parent=(NcJob*)(gROOT->GetListOfTasks()->FindObject(name.Data()));
+ Int_t isys=GetVetoIndex(name);
+ if (isys<0) return 0;
+
+ TObject* obj=fVetos->At(isys);
+ return Int_t(obj->GetUniqueID());
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::GetVetoIndex(TString name)
+{
+// Provide the array index of the specified veto system in fVetos.
+// The veto systems are found via the hash table fRegistry, which is
+// (re)built automatically when it is not consistent with fVetos,
+// e.g. after reading this IceVeto object from a file.
+//
+// In case the veto system is not present, a value -1 will be returned.
+
+ if (!fVetos) return -1;
+
+ Int_t nvetos=fVetos->GetEntries();
+ if (fRegistry->GetSize()!=nvetos)
+ {
+  fRegistry->Clear();
+  for (Int_t i=0; i<nvetos; i++)
+  {
+   TObject* obj=fVetos->At(i);
+   if (obj) fRegistry->Add(obj);
+  }
+ }
+
+ TObject* obj=fRegistry->FindObject(name.Data());
+ if (!obj) return -1;
+
+ // The array index follows directly from the ID of the veto system
+ Int_t isys=Int_t(obj->GetUniqueID())-1;
+ if (isys<0 || isys>=nvetos || fVetos->At(isys)!=obj) isys=fVetos->IndexOf(obj);
+
+ return isys;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetFusedEvaluation(Int_t flag)
+{
+// Select the evaluation strategy of the veto systems.
+//
+// flag = 0 --> Each veto system is evaluated separately by a scan over the fired DOMs
+//        1 --> All veto systems are evaluated in a single pass over the fired DOMs
+//
+// The single pass (fused) evaluation reads and tests each hit of a fired DOM only once
+// for all the veto systems this DOM belongs to, which is beneficial for overlapping
+// veto systems like "Start86" and its sub-systems "Upper86", "DustLayer86" etc.
+// Both strategies provide identical veto results.
+//
+// By default flag=0 is used.
+
+ if (flag) flag=1;
+ fFused=flag;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetRecordMode(Int_t mode)
+{
+// Select the way the veto hits are recorded in the "IceVeto-<system>" output devices
+// of the event.
+//
+// mode = 0 --> Full copies of the veto hits are recorded (kRecordCopy)
+//        1 --> The veto hits are recorded as references to the hits of the fired IceGOMs (kRecordRef)
+//        2 --> Only the veto observables (NdomVeto, NhitVeto, QtotVeto and VetoLevel) are recorded (kRecordCount)
+//
+// The modes 1 and 2 avoid the creation of (many) copies of the veto hits, which
+// keeps the memory allocation and output event size limited for large pass-1 filtering productions.
+// In mode 1 the corresponding DOM of each recorded veto hit is available via NcSignal::GetDevice().
+// Note that in the modes 0 and 1 the evaluation via the region summary (see SetRegionEvaluation)
+// only applies to veto systems without veto hits, since the region summary doesn't contain
+// the individual veto hits.
+//
+// By default mode=1 is used, which corresponds to the way the veto hits were recorded
+// before this facility was introduced.
+
+ if (mode<0 || mode>2)
+ {
+  cout << " *IceVeto::SetRecordMode* Unsupported mode : " << mode << endl;
+  return;
+ }
+
+ fRecord=mode;
+
+ UpdatePrototypes();
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetVerbose(Int_t level)
+{
+// Set the verbosity level of the event processing.
+//
+// level = 0 --> No printout
+//         1 --> The veto observables of each veto system are printed for each event
+//         2 --> In addition the time residuals of each veto hit are printed
+//
+// Note : In view of performance, the per-hit diagnostics (level=2) are only available
+//        when this class was compiled with the preprocessor flag ICEVETO_DIAGNOSTICS,
+//        e.g. via gSystem->AddIncludePath("-DICEVETO_DIAGNOSTICS") before the ACLiC
+//        compilation of IceVeto.cxx.
+//        Otherwise the veto hit loops only contain the quantities used for the veto decision.
+//
+// By default level=0 is used.
+
+ fVerbose=level;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetDecisionOnly(Int_t flag)
+{
+// Select whether the evaluation of a veto system is stopped as soon as its veto
+// criteria are met (flag=1) or that all the fired veto DOMs are always scanned (flag=0).
+//
+// For veto systems with loose criteria (e.g. "IceTop86" or "Upper86" with the default
+// parameters) the veto decision is often settled by the first valid veto hit,
+// which makes this a large gain for the bulk of the downgoing muon events.
+// Since in that case not all the veto hits are collected, the recorded observables
+// NdomVeto, NhitVeto and QtotVeto represent lower bounds, which is indicated by a value 1
+// of the "LowerBound" slot in the "IceVeto-<system>" output device.
+// This slot is only present in the output devices when flag=1 (or SetAnyVeto(1)) is used,
+// so the default layout of the output devices is not affected.
+// The resulting VetoLevel values are identical to the ones of the full evaluation.
+//
+// By default flag=0 is used.
+
+ if (flag) flag=1;
+ fDecision=flag;
+
+ UpdatePrototypes();
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetAnyVeto(Int_t flag)
+{
+// Select the evaluation policy of the veto systems.
+//
+// flag = 0 --> All veto systems are evaluated, providing the full per-system breakdown
+//        1 --> The evaluation stops at the first veto system that vetoes the event ("any veto" policy)
+//
+// In case only the rejection of vetoed events is needed (e.g. via an NcEventSelector
+// with SetRange("event","veto",0,0)), the "any veto" policy avoids the evaluation of the
+// other veto systems once the event is known to be vetoed.
+// With this policy, the veto systems are evaluated in the order of loosest veto criteria
+// and smallest number of veto DOMs first (see OrderVetoSystems) and the evaluation of
+// a veto system stops as soon as its veto criteria are met (see SetDecisionOnly).
+// The veto systems that were not evaluated are indicated by a value -1 of the "VetoLevel"
+// slot in their output device, and their (zero) observables are marked as lower bounds
+// via the "LowerBound" slot (see SetDecisionOnly).
+// The overall veto level of a vetoed event is in this case 1.
+//
+// Note : The "any veto" policy uses the per-system evaluation, so the setting of
+//        SetFusedEvaluation() is not used in that case.
+//
+// By default flag=0 is used, which is the (slower) full diagnostic mode.
+
+ if (flag) flag=1;
+ fAnyVeto=flag;
+
+ UpdatePrototypes();
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetRegionEvaluation(Int_t flag,Int_t nfired)
+{
+// Select the evaluation of the veto systems via the (string,DOM) region summary of the event.
+//
+// flag = 0 --> The veto systems are evaluated by a scan over the hits of the fired veto DOMs
+//        1 --> Veto systems without a time residual window are evaluated via the region summary
+//
+// The veto DOMs of each veto system are decomposed into rectangular regions in the
+// (string,DOM) plane, which for the pre-defined veto systems are mainly the string and DOM
+// ranges of their definition, complemented by small regions for the individual DOM
+// modifications, as for "HESE86".
+// For each event a summary of the vetoable signal amplitude, number of hits and fired DOMs
+// is built in a single pass over the hits of the fired DOMs, only for the strings which
+// contain a vetoable hit (see GetSummary).
+// The quantities of a veto system are then obtained from a few operations per region
+// and string with a vetoable hit, independent of the number of veto DOMs in the region.
+//
+// Since building the summary has a fixed cost per string with a vetoable hit, the hit scan
+// is more efficient for events with only a few fired DOMs.
+// So, the region summary is only used for events with at least "nfired" fired DOMs.
+//
+// Since the region summary doesn't contain the individual hits, this evaluation is only
+// used for veto systems of which the time residual is not taken into account (i.e. TresVetoMin>TresVetoMax).
+// In case the veto hits are recorded (i.e. the record modes 0 and 1, see SetRecordMode)
+// the region summary result is only used when it contains no veto hits for the veto system,
+// which is the common situation for events that are not vetoed. Otherwise, as well as for
+// the other veto systems, the hit scan is used to obtain the individual veto hits.
+// Both evaluations provide the same veto results.
+//
+// By default flag=0 and nfired=64 are used.
+
+ if (flag) flag=1;
+ fRegion=flag;
+ if (nfired<0) nfired=0;
+ fRegionMin=nfired;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetPreGate(Float_t qtot,Int_t ndom,TString hitclass)
+{
+// Set the criteria of the pre-veto gate, by which only events with a total signal
+// amplitude of at least "qtot" and at least "ndom" DOMs with a signal for the (non-SLC)
+// hits of the class "hitclass" are evaluated.
+// The observables of the gate are obtained from the cached reference quantities of these
+// hits (see PassGate), which are subsequently re-used by the veto systems with the same
+// hit class, so the gate doesn't repeat any signal summation.
+// Events that fail the gate skip the evaluation of all the veto systems and are treated
+// as not evaluated, i.e. no output devices of the veto systems are created and no veto level
+// is entered in the event structure.
+// To allow a clear distinction with the events without hits, the events that failed the gate
+// obtain the device "IceVeto-Gate" (see StoreGate), which contains a value 1 in the slot "Gated"
+// together with the observables of the gate in the slots "QtotGate" and "NdomGate".
+// This replaces a separate preselection on the event charge, like the one indicated in
+// the macro test.cc, which would repeat the same signal summation.
+//
+// The pre-veto gate is disabled by qtot<=0 and ndom<=0, which is the default.
+
+ fGateQtot=qtot;
+ fGateNdom=ndom;
+ fGateClass=hitclass;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetInstrumentation(Int_t flag)
+{
+// Select the recording of timing and counter statistics of the event processing.
+//
+// flag = 0 --> No statistics are recorded
+//        1 --> The timing and counter statistics are recorded
+//
+// For each veto system the cumulative evaluation time, the number of visited veto DOMs,
+// the number of tested hits, the number of hits rejected by each of the SLC, amplitude
+// and time residual criteria, the number of accepted veto hits and the number of early exits
+// (see SetDecisionOnly and SetAnyVeto) are recorded.
+// In addition, the cumulative time of the processing stages (DOM indexing, reference quantities,
+// veto evaluation and output device construction) is recorded.
+// The times are obtained from the std::chrono::steady_clock.
+//
+// The statistics are recorded in the work space of each thread, and are merged at the
+// moment they are requested via Data(3), GetStats() or CreateStatsDevice().
+// The counters of the hits are accumulated within the hit loops of the veto evaluation,
+// so the recorded evaluation times include their (small) overhead.
+//
+// Notes :
+// -------
+// 1) With the single pass evaluation (see SetFusedEvaluation) all veto systems are evaluated
+//    together, so the evaluation time is only available for the "Veto evaluation" stage.
+// 2) For veto systems that are evaluated via the region summary (see SetRegionEvaluation)
+//    no individual hits are tested, which is indicated by the region evaluation counter.
+//
+// By default flag=0 is used.
+
+ if (flag) flag=1;
+ fInstrument=flag;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ResetStats()
+{
+// Reset the timing and counter statistics of all the work spaces.
+
+ std::lock_guard<std::mutex> lock(fPool->fMutex);
+
+ for (Int_t i=0; i<=Int_t(fPool->fScratches.size()); i++)
+ {
+  IceVetoScratch* w=fScratch;
+  if (i<Int_t(fPool->fScratches.size())) w=fPool->fScratches[i];
+  if (!w) continue;
+
+  for (Int_t j=0; j<Int_t(w->fStats.size()); j++)
+  {
+   w->fStats[j]=IceVetoStats();
+  }
+  for (Int_t j=0; j<kNstages; j++)
+  {
+   w->fStages[j]=IceVetoStats();
+  }
+ }
+
+ fDoneStats.clear();
+ for (Int_t j=0; j<kNstages; j++)
+ {
+  fDoneStages[j]=IceVetoStats();
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::GetStats(std::vector<IceVetoStats>& sys,IceVetoStats* stages) const
+{
+// Provide the timing and counter statistics (see SetInstrumentation) of the veto systems
+// in "sys" and of the processing stages in the array "stages" (if provided), which has
+// to have kNstages entries.
+// The statistics of the work spaces of all the threads are merged.
+
+ Int_t nvetos=0;
+ if (fVetos) nvetos=fVetos->GetEntries();
+
+ sys.assign(nvetos,IceVetoStats());
+ if (stages)
+ {
+  for (Int_t j=0; j<kNstages; j++)
+  {
+   stages[j]=IceVetoStats();
+  }
+ }
+
+ std::lock_guard<std::mutex> lock(fPool->fMutex);
+
+ // The statistics of the work spaces that were already released
+ for (Int_t j=0; j<nvetos && j<Int_t(fDoneStats.size()); j++)
+ {
+  IceVetoAddStats(sys[j],fDoneStats[j]);
+ }
+ for (Int_t j=0; stages && j<kNstages; j++)
+ {
+  IceVetoAddStats(stages[j],fDoneStages[j]);
+ }
+
+ for (Int_t i=0; i<=Int_t(fPool->fScratches.size()); i++)
+ {
+  IceVetoScratch* w=fScratch;
+  if (i<Int_t(fPool->fScratches.size())) w=fPool->fScratches[i];
+  if (!w) continue;
+
+  for (Int_t j=0; j<nvetos && j<Int_t(w->fStats.size()); j++)
+  {
+   IceVetoAddStats(sys[j],w->fStats[j]);
+  }
+  for (Int_t j=0; stages && j<kNstages; j++)
+  {
+   IceVetoAddStats(stages[j],w->fStages[j]);
+  }
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+NcDevice* IceVeto::CreateStatsDevice() const
+{
+// Provide the timing and counter statistics (see SetInstrumentation) as an NcDevice
+// with the name "IceVeto-Stats", which may for instance be written to an output file.
+// The device contains a hit for each veto system and each processing stage,
+// with the name of the veto system or stage and the named slots "Events", "Time"
+// (in ms), "DOMs", "Hits", "RejSLC", "RejAmp", "RejTres", "VetoHits", "Early" and "Regions".
+//
+// Note : The returned device is not owned by this IceVeto object and has to be
+//        deleted by the user.
+
+ std::vector<IceVetoStats> sys;
+ IceVetoStats stages[kNstages];
+ GetStats(sys,stages);
+
+ const char* stagenames[kNstages]={"Stage-Index","Stage-Reference","Stage-Veto","Stage-Output"};
+
+ NcDevice* dev=new NcDevice();
+ dev->SetNameTitle("IceVeto-Stats","IceVeto timing and counter statistics");
+
+ const char* slotnames[10]={"Events","Time","DOMs","Hits","RejSLC","RejAmp","RejTres","VetoHits","Early","Regions"};
+ NcSignal sx;
+ for (Int_t i=0; i<10; i++)
+ {
+  sx.AddNamedSlot(slotnames[i]);
+ }
+
+ Int_t nvetos=sys.size();
+ const IceVetoStats* st=0;
+ TObject* obj=0;
+ for (Int_t j=0; j<nvetos+kNstages; j++)
+ {
+  if (j<nvetos)
+  {
+   obj=fVetos->At(j);
+   if (!obj) continue;
+   sx.SetName(obj->GetName());
+   st=&sys[j];
+  }
+  else
+  {
+   sx.SetName(stagenames[j-nvetos]);
+   st=&stages[j-nvetos];
+  }
+
+  sx.SetSignal(st->fEvents,"Events");
+  sx.SetSignal(st->fTime*1.e-6,"Time");
+  sx.SetSignal(st->fDoms,"DOMs");
+  sx.SetSignal(st->fHits,"Hits");
+  sx.SetSignal(st->fRejSLC,"RejSLC");
+  sx.SetSignal(st->fRejAmp,"RejAmp");
+  sx.SetSignal(st->fRejTres,"RejTres");
+  sx.SetSignal(st->fVetoHits,"VetoHits");
+  sx.SetSignal(st->fEarly,"Early");
+  sx.SetSignal(st->fRegions,"Regions");
+  dev->AddHit(sx);
+ }
+
+ return dev;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ListStats() const
+{
+// Print the timing and counter statistics (see SetInstrumentation).
+
+ std::vector<IceVetoStats> sys;
+ IceVetoStats stages[kNstages];
+ GetStats(sys,stages);
+
+ const char* stagenames[kNstages]={"DOM indexing","Reference quantities","Veto evaluation","Output devices"};
+
+ cout << " *IceVeto::Data()* Timing and counter statistics";
+ if (!fInstrument) cout << " (instrumentation not active, see SetInstrumentation)";
+ cout << endl;
+
+ Double_t nevt=0;
+ for (Int_t j=0; j<kNstages; j++)
+ {
+  nevt=stages[j].fEvents;
+  cout << " Stage " << stagenames[j] << " : events=" << stages[j].fEvents << " time=" << stages[j].fTime*1.e-6 << " ms";
+  if (nevt>0) cout << " (" << stages[j].fTime*1.e-3/nevt << " us/event)";
+  if (j==kStageIndex)
+  {
+   cout << " fired DOMs=" << stages[j].fDoms << " veto DOM hits=" << stages[j].fHits << " pre-veto gate rejects=" << stages[j].fEarly;
+  }
+  cout << endl;
+ }
+
+ TObject* obj=0;
+ const IceVetoStats* st=0;
+ for (Int_t isys=0; isys<Int_t(sys.size()); isys++)
+ {
+  obj=fVetos->At(isys);
+  if (!obj) continue;
+
+  st=&sys[isys];
+  nevt=st->fEvents;
+  cout << " Veto system " << obj->GetName() << " : events=" << st->fEvents << " time=" << st->fTime*1.e-6 << " ms";
+  if (nevt>0) cout << " (" << st->fTime*1.e-3/nevt << " us/event)";
+  cout << endl;
+  cout << "  veto DOMs=" << st->fDoms << " hits=" << st->fHits << " rejected SLC=" << st->fRejSLC
+       << " Amp=" << st->fRejAmp << " Tres=" << st->fRejTres << " veto hits=" << st->fVetoHits
+       << " early exits=" << st->fEarly << " region evaluations=" << st->fRegions << endl;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::GetDOMIndex(Int_t domid)
+{
+// Provide the index in the (dense) DOM lookup table for the DOM with the specified ID.
+// The DOM ID follows the convention id=100*string+dom, where a negative string number
+// results in a negative id, as used in AddVetoDOMs() and RemoveVetoDOMs().
+// The lookup table covers the string numbers [-86,86] and the DOM numbers [1,64].
+//
+// In case the DOM ID is outside the covered range, a value -1 will be returned.
+
+ Int_t jstring=domid/100;
+ Int_t jdom=abs(domid)%100;
+
+ if (abs(jstring)>kMaxString || jdom<1 || jdom>kMaxDOM) return -1;
+
+ return (jstring+kMaxString)*kMaxDOM+jdom-1;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::IndexDOMs(IceEvent* evt,IceVetoScratch& w) const
+{
+// Build the lookup table of the fired DOMs of the specified event in the work space "w".
+// After invokation, a fired DOM can be obtained via w.fFired[GetDOMIndex(domid)],
+// which avoids a scan over all the devices of the event for every veto DOM.
+
+ // Reset the entries of the previous event
+ for (Int_t i=0; i<w.fNfired; i++)
+ {
+  w.fFired[w.fFiredIndex[i]]=0;
+ }
+ w.fNfired=0;
+
+ if (!evt) return;
+
+ w.fDOMs.Clear();
+ evt->GetDevices("IceGOM",&w.fDOMs);
+
+ NcDevice* omx=0;
+ Int_t index=0;
+ for (Int_t i=0; i<w.fDOMs.GetEntries(); i++)
+ {
+  omx=(NcDevice*)w.fDOMs.At(i);
+  if (!omx) continue;
+
+  index=GetDOMIndex(Int_t(omx->GetUniqueID()));
+  if (index<0 || w.fFired[index]) continue;
+
+  w.fFired[index]=omx;
+  w.fFiredIndex[w.fNfired]=index;
+  w.fNfired++;
+ }
+
+ CacheHits(w);
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::CacheHits(IceVetoScratch& w) const
+{
+// Store the calibrated "LE" and "ADC" values, the "SLC" flag and the dead flag of the "LE" signal of all the hits
+// of the fired DOMs of the current event in the work space "w".
+// In this way the (virtual) signal access with the de-calibration and calibration
+// of mode 8 (see NcSignal::GetSignal) is performed only once for each hit,
+// after which the reference quantities (see GetReference) and the veto hit criteria
+// (see FlattenHits) are obtained from these stored values.
+// The hits of each fired DOM are stored consecutively, and may be located via GetCachedHit().
+
+ w.fNcache=0;
+
+ NcDevice* omx=0;
+ NcSignal* sx=0;
+ Int_t index=0;
+ Int_t nh=0;
+ Int_t jhit=0;
+ for (Int_t ifired=0; ifired<w.fNfired; ifired++)
+ {
+  index=w.fFiredIndex[ifired];
+  omx=w.fFired[index];
+  w.fCacheFirst[index]=w.fNcache;
+  w.fCacheN[index]=0;
+
+  nh=omx->GetNhits();
+  if (!nh) continue;
+
+  // Enlarge the arrays if needed
+  if (w.fNcache+nh>Int_t(w.fCsig.size()))
+  {
+   Int_t size=2*(w.fNcache+nh);
+   w.fCsig.resize(size);
+   w.fCle.resize(size);
+   w.fCadc.resize(size);
+   w.fCslc.resize(size);
+   w.fCdead.resize(size);
+  }
+
+  for (Int_t ih=1; ih<=nh; ih++)
+  {
+   sx=omx->GetHit(ih);
+   if (!sx) continue;
+
+   jhit=w.fNcache;
+   w.fCsig[jhit]=sx;
+   w.fCle[jhit]=sx->GetSignal("LE",8);
+   w.fCadc[jhit]=sx->GetSignal("ADC",8);
+   w.fCslc[jhit]=0;
+   if (sx->GetSignal("SLC")) w.fCslc[jhit]=1;
+   w.fCdead[jhit]=sx->GetDeadValue("LE");
+   w.fNcache++;
+  }
+
+  w.fCacheN[index]=w.fNcache-w.fCacheFirst[index];
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::PassGate(IceEvent* evt,IceVetoScratch& w,IceVetoResult& res) const
+{
+// Apply the pre-veto gate (see SetPreGate) to the event "evt".
+// The total signal amplitude and the number of DOMs with a signal are obtained from
+// the reference quantities of the non-SLC hits of the gate hit class (see GetReference).
+// These reference quantities are kept in the work space "w", so they are not
+// determined again by the veto systems with the same hit class.
+// The observables of the gate are provided in "res".
+//
+// The return argument is 1 if the event passes the gate and 0 otherwise.
+
+ res.fGateQtot=0;
+ res.fGateNdom=0;
+
+ IceVetoRef* ref=GetReference(evt,fGateClass,-2,w);
+ if (!ref) return 0;
+
+ res.fGateQtot=ref->fQtot;
+ res.fGateNdom=ref->fNdom;
+
+ if (ref->fQtot<fGateQtot || ref->fNdom<fGateNdom) return 0;
+
+ return 1;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::StoreGate(IceEvent* evt,const IceVetoResult& res)
+{
+// Mark the event "evt" that failed the pre-veto gate (see SetPreGate), as indicated by "res".
+// A copy of the output device "IceVeto-Gate" is stored in the event, which contains a value 1
+// in the slot "Gated" and the observables of the gate in the slots "QtotGate" and "NdomGate".
+// No veto level is entered in the event structure, since the event was not evaluated.
+//
+// Note : Like for StoreResult(), nothing is stored for an event with DevCopy mode 0.
+
+ if (!evt || !res.fGated || !evt->GetDevCopy()) return;
+
+ evt->AddDevice(fGate);
+ NcDevice* dev=evt->GetDevice(evt->GetNdevices());
+ if (!dev || dev==&fGate) return;
+
+ dev->SetSignal(1,1);
+ dev->SetSignal(res.fGateQtot,2);
+ dev->SetSignal(res.fGateNdom,3);
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::GetCachedHit(NcSignal* sx,IceVetoScratch& w) const
+{
+// Provide the position of the hit "sx" in the calibrated hit data of the work space "w"
+// as stored by CacheHits().
+// Only the few hits of the corresponding DOM need to be scanned.
+//
+// In case the hit is not present in the calibrated hit data, a value -1 is returned.
+
+ if (!sx) return -1;
+
+ NcDevice* omx=sx->GetDevice();
+ if (!omx) return -1;
+
+ Int_t index=GetDOMIndex(Int_t(omx->GetUniqueID()));
+ if (index<0 || w.fFired[index]!=omx) return -1;
+
+ Int_t first=w.fCacheFirst[index];
+ Int_t last=first+w.fCacheN[index];
+ for (Int_t j=first; j<last; j++)
+ {
+  if (w.fCsig[j]==sx) return j;
+ }
+
+ return -1;
+}
+///////////////////////////////////////////////////////////////////////////
+const Double_t* IceVeto::GetDOMPosition(Int_t index,NcDevice* omx,IceVetoScratch& w) const
+{
+// Provide the cartesian coordinates of the DOM "omx" with lookup table index "index"
+// from the geometry table of the work space "w".
+// Since the DOM positions are fixed, the position of a DOM is obtained via
+// NcDevice::GetPosition() only at its first occurrence, after which the
+// coordinates are provided from the geometry table.
+// In this way no temporary NcPosition objects and frame conversions are needed
+// for the distance computations of each event.
+// The geometry tables may be reset via ResetGeometry().
+//
+// For a DOM outside the range of the lookup table, the coordinates are provided
+// via a temporary storage in the work space.
+
+ if (index<0 || index>=kNdomIndex)
+ {
+  w.fRx=omx->GetPosition();
+  w.fXtmp[0]=w.fRx.GetX(1,"car");
+  w.fXtmp[1]=w.fRx.GetX(2,"car");
+  w.fXtmp[2]=w.fRx.GetX(3,"car");
+  return w.fXtmp;
+ }
+
+ if (!w.fGeoSet[index])
+ {
+  w.fRx=omx->GetPosition();
+  w.fGeo[index][0]=w.fRx.GetX(1,"car");
+  w.fGeo[index][1]=w.fRx.GetX(2,"car");
+  w.fGeo[index][2]=w.fRx.GetX(3,"car");
+  w.fGeoSet[index]=1;
+ }
+
+ return w.fGeo[index];
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::GetSummary(Int_t slc,Float_t amp,IceVetoScratch& w) const
+{
+// Provide the index of the (string,DOM) region summary of the current event for the
+// hits satisfying the SLC selection "slc" (see SLCVeto) and minimal amplitude "amp".
+// The summary is built at the first request by a single pass over the calibrated hit
+// data of the fired DOMs (see CacheHits).
+// The summary only contains the rows (strings) of the DOM lookup table with a vetoable hit.
+// For each of these rows the prefix sums over the DOMs of the amplitudes and number
+// of vetoable hits are formed, together with a bit pattern of the DOMs with a vetoable hit.
+// This implies that the work to build a summary only scales with the number of
+// fired DOMs and strings, and not with the size of the DOM lookup table.
+//
+// In case the maximum number of summaries is exceeded, a value -1 is returned.
+
+ for (Int_t i=0; i<w.fNsum; i++)
+ {
+  if (w.fSumSLC[i]==slc && w.fSumAmp[i]==amp) return i;
+ }
+
+ if (w.fNsum>=IceVetoScratch::kMaxSummaries) return -1;
+
+ Int_t isum=w.fNsum;
+ w.fNsum++;
+ w.fSumSLC[isum]=slc;
+ w.fSumAmp[isum]=amp;
+
+ // Reset the rows of the previous use of this summary
+ Int_t* rows=w.fSumRows[isum];
+ Int_t* slots=w.fSumSlot[isum];
+ Int_t& nrows=w.fSumNrows[isum];
+ for (Int_t k=0; k<nrows; k++)
+ {
+  slots[rows[k]]=-1;
+ }
+ nrows=0;
+
+ // Accumulate the vetoable hits of each fired DOM in its row
+ const Int_t ncol=IceVetoScratch::kNcols;
+ Double_t* q=0;
+ Int_t* h=0;
+ Int_t index=0;
+ Int_t row=0;
+ Int_t dom=0;
+ Int_t slot=0;
+ Int_t first=0;
+ Int_t last=0;
+ Int_t nveto=0;
+ Double_t qveto=0;
+ for (Int_t ifired=0; ifired<w.fNfired; ifired++)
+ {
+  index=w.fFiredIndex[ifired];
+  first=w.fCacheFirst[index];
+  last=first+w.fCacheN[index];
+  nveto=0;
+  qveto=0;
+  for (Int_t j=first; j<last; j++)
+  {
+   if (!slc && w.fCslc[j]) continue;
+   if (w.fCadc[j]<amp) continue;
+   qveto+=w.fCadc[j];
+   nveto++;
+  }
+  if (!nveto) continue;
+
+  row=index/kMaxDOM;
+  dom=index%kMaxDOM+1;
+  slot=slots[row];
+  if (slot<0)
+  {
+   slot=nrows;
+   slots[row]=slot;
+   rows[slot]=row;
+   nrows++;
+   w.fSumBits[isum][slot]=0;
+   q=w.fSumQ[isum][slot];
+   h=w.fSumH[isum][slot];
+   for (Int_t col=0; col<ncol; col++)
+   {
+    q[col]=0;
+    h[col]=0;
+   }
+  }
+  w.fSumQ[isum][slot][dom]+=qveto;
+  w.fSumH[isum][slot][dom]+=nveto;
+  w.fSumBits[isum][slot]|=ULong64_t(1)<<(dom-1);
+ }
+
+ // Form the prefix sums over the DOMs of the rows with vetoable hits
+ for (Int_t k=0; k<nrows; k++)
+ {
+  q=w.fSumQ[isum][k];
+  h=w.fSumH[isum][k];
+  for (Int_t col=1; col<ncol; col++)
+  {
+   q[col]+=q[col-1];
+   h[col]+=h[col-1];
+  }
+ }
+
+ return isum;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::EvaluateRegion(Int_t isys,IceVetoScratch& w) const
+{
+// Evaluate the veto system with array index "isys" for the current event via the
+// (string,DOM) region summary, in case this veto system qualifies (see SetRegionEvaluation).
+// The accumulated amplitude and number of veto hits are obtained from the prefix sums
+// over the DOMs by 2 lookups, and the number of DOMs with a veto hit by a bit count,
+// for each region of the veto system and each of its strings with a vetoable hit.
+// In case veto hits have to be recorded (see SetRecordMode), the result is only used
+// when the veto system has no veto hits, since otherwise the individual veto hits
+// have to be obtained via the hit scan.
+//
+// The return argument is 1 if the veto system was evaluated and 0 otherwise.
+
+ if (!fRegion || w.fNfired<fRegionMin) return 0;
+
+ IceVetoSys* vsys=&w.fSys[isys];
+ const IceVetoConfig* cfg=vsys->fCfg;
+ if (!vsys->fActive || !cfg) return 0;
+
+ if (cfg->fTresMin<=cfg->fTresMax) return 0;
+
+ if (isys>=Int_t(fRects.size())) return 0;
+
+ Int_t isum=GetSummary(cfg->fSLC,cfg->fAmpMin,w);
+ if (isum<0) return 0;
+
+ const Int_t* rows=w.fSumRows[isum];
+ const Int_t* slots=w.fSumSlot[isum];
+ const Int_t nrows=w.fSumNrows[isum];
+ const std::vector<IceVetoRect>& rects=fRects[isys];
+ Double_t qtot=0;
+ Int_t nhit=0;
+ Int_t ndom=0;
+ Int_t slot=0;
+ Int_t row=0;
+ ULong64_t bits=0;
+ for (Int_t i=0; i<Int_t(rects.size()); i++)
+ {
+  const IceVetoRect& r=rects[i];
+  bits=(~ULong64_t(0)>>(kMaxDOM-(r.fDom2-r.fDom1+1)))<<(r.fDom1-1); // The DOMs [fDom1,fDom2]
+
+  // Loop over the rows of the region or over the rows with vetoable hits, whichever is smaller
+  if (r.fRow2-r.fRow1<nrows)
+  {
+   for (row=r.fRow1; row<=r.fRow2; row++)
+   {
+    slot=slots[row];
+    if (slot<0) continue;
+    qtot+=w.fSumQ[isum][slot][r.fDom2]-w.fSumQ[isum][slot][r.fDom1-1];
+    nhit+=w.fSumH[isum][slot][r.fDom2]-w.fSumH[isum][slot][r.fDom1-1];
+    ndom+=std::bitset<64>(w.fSumBits[isum][slot]&bits).count();
+   }
+  }
+  else
+  {
+   for (slot=0; slot<nrows; slot++)
+   {
+    row=rows[slot];
+    if (row<r.fRow1 || row>r.fRow2) continue;
+    qtot+=w.fSumQ[isum][slot][r.fDom2]-w.fSumQ[isum][slot][r.fDom1-1];
+    nhit+=w.fSumH[isum][slot][r.fDom2]-w.fSumH[isum][slot][r.fDom1-1];
+    ndom+=std::bitset<64>(w.fSumBits[isum][slot]&bits).count();
+   }
+  }
+ }
+
+ // The individual veto hits to be recorded are obtained via the hit scan
+ if (nhit && fRecord!=kRecordCount) return 0;
+
+ vsys->fQtot=qtot;
+ vsys->fNhit=nhit;
+ vsys->fNdom=ndom;
+ vsys->fVetoHit=0;
+ vsys->fRegion=1;
+
+ return 1;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::FlattenHits(IceVetoScratch& w) const
+{
+// Store the hits of the fired DOMs which belong to any veto system in the
+// contiguous arrays of the work space "w".
+// The hits of each DOM are stored consecutively, in the same order as they
+// are encountered in EvaluateSystem() and EvaluateFused().
+// The hit data are obtained from the calibrated hit data stored by CacheHits(),
+// and the single hit veto criteria can be applied by a simple loop
+// over these arrays (see CutHits), which allows auto-vectorization by the compiler.
+
+ w.fNhits=0;
+
+ NcDevice* omx=0;
+ Int_t index=0;
+ Int_t nh=0;
+ Int_t jhit=0;
+ Int_t jcache=0;
+ const Double_t* pos=0;
+ Double_t x=0;
+ Double_t y=0;
+ Double_t z=0;
+ for (Int_t ifired=0; ifired<w.fNfired; ifired++)
+ {
+  index=w.fFiredIndex[ifired];
+
+  if (!((fAnyMask[index/kMaxDOM]>>(index%kMaxDOM))&1)) continue;
+
+  omx=w.fFired[index];
+  if (!omx) continue;
+
+  nh=w.fCacheN[index];
+  if (!nh) continue;
+
+  // Enlarge the arrays if needed
+  if (w.fNhits+nh>Int_t(w.fHx.size()))
+  {
+   Int_t size=2*(w.fNhits+nh);
+   w.fHx.resize(size);
+   w.fHy.resize(size);
+   w.fHz.resize(size);
+   w.fHle.resize(size);
+   w.fHadc.resize(size);
+   w.fHslc.resize(size);
+   w.fHdom.resize(size);
+   w.fHsig.resize(size);
+   w.fHpass.resize(size);
+  }
+
+  pos=GetDOMPosition(index,omx,w);
+  x=pos[0];
+  y=pos[1];
+  z=pos[2];
+
+  jcache=w.fCacheFirst[index];
+  for (Int_t ih=0; ih<nh; ih++)
+  {
+   jhit=w.fNhits;
+   w.fHx[jhit]=x;
+   w.fHy[jhit]=y;
+   w.fHz[jhit]=z;
+   w.fHle[jhit]=w.fCle[jcache];
+   w.fHadc[jhit]=w.fCadc[jcache];
+   w.fHslc[jhit]=w.fCslc[jcache];
+   w.fHdom[jhit]=index;
+   w.fHsig[jhit]=w.fCsig[jcache];
+   w.fNhits++;
+   jcache++;
+  }
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::CutHits(const IceVetoConfig* cfg,const IceVetoRef* ref,Double_t c,IceVetoScratch& w) const
+{
+// Apply the SLC, amplitude and time residual criteria of the veto system with the
+// compiled parameters "cfg" to all the hits stored by FlattenHits().
+// The time residual is determined with respect to the reference quantities "ref".
+// The outcome for each hit is stored in w.fHpass.
+// The loop below is kept free of branches and function calls, such that it can
+// be vectorized by the compiler (e.g. when compiled with -O3).
+// The light speed "c" has to be provided in m/ns.
+
+ if (!cfg || !ref) return;
+
+ const Int_t n=w.fNhits;
+ const Double_t* x=w.fHx.data();
+ const Double_t* y=w.fHy.data();
+ const Double_t* z=w.fHz.data();
+ const Double_t* le=w.fHle.data();
+ const Float_t* adc=w.fHadc.data();
+ const Int_t* slc=w.fHslc.data();
+ Int_t* pass=w.fHpass.data();
+
+ const Double_t x0=ref->fX0[0];
+ const Double_t y0=ref->fX0[1];
+ const Double_t z0=ref->fX0[2];
+ const Double_t t0=ref->fT0;
+ const Float_t ampmin=cfg->fAmpMin;
+ const Double_t tresmin=cfg->fTresMin;
+ const Double_t tresmax=cfg->fTresMax;
+ const Int_t noslc=(cfg->fSLC) ? 0 : 1;
+ const Int_t nowin=(cfg->fTresMin<=cfg->fTresMax) ? 0 : 1;
+
+ Double_t dx=0;
+ Double_t dy=0;
+ Double_t dz=0;
+ Double_t tres0=0;
+ for (Int_t j=0; j<n; j++)
+ {
+  dx=x[j]-x0;
+  dy=y[j]-y0;
+  dz=z[j]-z0;
+  tres0=(le[j]-t0)-(sqrt(dx*dx+dy*dy+dz*dz)/c);
+  pass[j]=(1-(noslc&slc[j])) & (adc[j]>=ampmin) & (nowin | ((tres0>=tresmin) & (tres0<=tresmax)));
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::SetVetoDOM(Int_t isys,Int_t index,Int_t flag)
+{
+// Set (flag=1) or reset (flag=0) the DOM with the specified lookup table index
+// in the compiled veto DOM mask of the veto system with array index "isys".
+
+ if (isys<0 || index<0 || index>=kNdomIndex) return;
+
+ ULong64_t bit=1;
+ bit=bit<<(index%kMaxDOM);
+
+ ULong64_t& word=fMasks[isys*kNwords+index/kMaxDOM];
+ if (flag)
+ {
+  word|=bit;
+ }
+ else
+ {
+  word&=~bit;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::AddVetoMask(Int_t isys,const ULong64_t* mask)
+{
+// Add the DOMs of the compiled veto DOM mask "mask" to the veto system with array index "isys".
+// Only the DOMs which are not yet present in the veto system are added, for which
+// the compiled veto DOM mask of the veto system itself is used, so that no searches
+// over the veto DOMs of the device are needed.
+//
+// Note : The union of the masks (see UpdateAnyMask) and the compiled parameters
+//        (see LoadConfig) should be updated by the caller.
+//
+// The return argument is the number of added veto DOMs.
+
+ if (!fVetos || !mask || isys<0 || isys>=fVetos->GetEntries()) return 0;
+
+ NcVeto* dveto=(NcVeto*)fVetos->At(isys);
+ if (!dveto) return 0;
+
+ Int_t nadd=0;
+ ULong64_t bits=0;
+ Int_t index=0;
+ Int_t js=0;
+ Int_t jd=0;
+ Int_t idom=0;
+ NcSignal vdom;
+ for (Int_t iw=0; iw<kNwords; iw++)
+ {
+  bits=mask[iw]&~fMasks[isys*kNwords+iw];
+  if (!bits) continue;
+
+  for (Int_t ib=0; ib<kMaxDOM; ib++)
+  {
+   if (!((bits>>ib)&1)) continue;
+
+   index=iw*kMaxDOM+ib;
+   js=iw-kMaxString;
+   jd=ib+1;
+   idom=100*abs(js)+jd;
+   if (js<0) idom=-idom;
+
+   vdom.SetUniqueID(idom);
+   dveto->AddHit(vdom);
+   SetVetoDOM(isys,index,1);
+   nadd++;
+  }
+ }
+
+ return nadd;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::ParseVetoDOMs(TString file,ULong64_t* mask,std::vector<Int_t>& extra) const
+{
+// Read the veto DOMs listed as "(string, dom)" entries in the text file "file"
+// and set the corresponding bits in the compiled veto DOM mask "mask".
+// The file is read in blocks and parsed character by character, without
+// any intermediate (line) storage.
+// The IDs of the DOMs outside the range of the DOM lookup table are provided in "extra".
+//
+// The return argument is 1 if the file could be read and 0 otherwise.
+
+ for (Int_t iw=0; iw<kNwords; iw++)
+ {
+  mask[iw]=0;
+ }
+ extra.clear();
+
+ FILE* fp=fopen(file.Data(),"r");
+ if (!fp) return 0;
+
+ const Int_t nbuf=65536;
+ char buf[nbuf];
+ Int_t nread=0;
+ Int_t state=0; // 0=outside an entry 1=string number 2=DOM number
+ Int_t sign=1;
+ Int_t digits=0;
+ Int_t value=0;
+ Int_t js=0;
+ Int_t idom=0;
+ Int_t index=0;
+ char ch=0;
+ while ((nread=Int_t(fread(buf,1,nbuf,fp)))>0)
+ {
+  for (Int_t i=0; i<nread; i++)
+  {
+   ch=buf[i];
+
+   if (ch=='(')
+   {
+    state=1;
+    sign=1;
+    digits=0;
+    value=0;
+    continue;
+   }
+
+   if (!state) continue;
+
+   if (ch>='0' && ch<='9')
+   {
+    value=10*value+(ch-'0');
+    digits++;
+   }
+   else if (ch=='-' && !digits)
+   {
+    sign=-1;
+   }
+   else if (ch==',' && state==1 && digits)
+   {
+    js=sign*value;
+    state=2;
+    sign=1;
+    digits=0;
+    value=0;
+   }
+   else if (ch==')' && state==2 && digits)
+   {
+    idom=100*abs(js)+value;
+    if (js<0) idom=-idom;
+    index=GetDOMIndex(idom);
+    if (index>=0)
+    {
+     mask[index/kMaxDOM]|=(ULong64_t(1)<<(index%kMaxDOM));
+    }
+    else
+    {
+     extra.push_back(idom);
+    }
+    state=0;
+   }
+   else if (ch!=' ' && ch!='\t')
+   {
+    state=0; // Invalid entry
+   }
+  }
+ }
+
+ fclose(fp);
+ return 1;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::ReadMaskCache(TString cache,TString file,ULong64_t* mask) const
+{
+// Read the compiled veto DOM mask "mask" from the binary cache file "cache",
+// which was produced by WriteMaskCache() from the text file "file".
+// The cache file is memory mapped, so that the mask is obtained without buffered reading.
+//
+// The return argument is 1 if a valid cache for "file" was found and 0 otherwise.
+
+ struct stat src;
+ if (stat(file.Data(),&src)) return 0;
+
+ Long64_t hdr[gIceVetoMaskNhdr];
+ IceVetoMaskHeader(src,hdr);
+ const Int_t nbytes=Int_t(sizeof(hdr)+kNwords*sizeof(ULong64_t));
+
+ Int_t ok=0;
+
+#ifndef _WIN32
+ int fd=open(cache.Data(),O_RDONLY);
+ if (fd<0) return 0;
+
+ struct stat cst;
+ if (!fstat(fd,&cst) && cst.st_size==nbytes)
+ {
+  void* addr=mmap(0,nbytes,PROT_READ,MAP_PRIVATE,fd,0);
+  if (addr!=MAP_FAILED)
+  {
+   const Long64_t* h=(const Long64_t*)addr;
+   Int_t same=1;
+   for (Int_t i=0; i<gIceVetoMaskNhdr; i++)
+   {
+    if (h[i]!=hdr[i]) same=0;
+   }
+   if (same)
+   {
+    const ULong64_t* words=(const ULong64_t*)(h+gIceVetoMaskNhdr);
+    for (Int_t iw=0; iw<kNwords; iw++)
+    {
+     mask[iw]=words[iw];
+    }
+    ok=1;
+   }
+   munmap(addr,nbytes);
+  }
+ }
+ close(fd);
+#else
+ FILE* fp=fopen(cache.Data(),"rb");
+ if (!fp) return 0;
+
+ Long64_t h[gIceVetoMaskNhdr];
+ if (fread(h,sizeof(h),1,fp)==1 && !memcmp(h,hdr,sizeof(h)))
+ {
+  if (fread(mask,sizeof(ULong64_t),kNwords,fp)==size_t(kNwords)) ok=1;
+ }
+ fclose(fp);
+#endif
+
+ return ok;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::WriteMaskCache(TString cache,TString file,const ULong64_t* mask) const
+{
+// Write the compiled veto DOM mask "mask", as obtained from the text file "file",
+// into the binary cache file "cache".
+// The cache file consists of a header with an identifier, the mask size and
+// the size and modification time (seconds and nanoseconds) of "file", followed by the mask words.
+// In case the cache file can't be created (e.g. for a read-only directory) no cache is written,
+// which is only reported for a verbosity level (see SetVerbose) of at least 1.
+
+ struct stat src;
+ if (stat(file.Data(),&src)) return;
+
+ FILE* fp=fopen(cache.Data(),"wb");
+ if (!fp)
+ {
+  if (fVerbose) cout << " *IceVeto::WriteMaskCache* Cache file could not be created : " << cache.Data() << endl;
+  return;
+ }
+
+ Long64_t hdr[gIceVetoMaskNhdr];
+ IceVetoMaskHeader(src,hdr);
+ fwrite(hdr,sizeof(hdr),1,fp);
+ fwrite(mask,sizeof(ULong64_t),kNwords,fp);
+ fclose(fp);
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::UpdateAnyMask()
+{
+// Update the union of the compiled veto DOM masks of all veto systems.
+// This allows to skip fired DOMs which are not part of any veto system
+// by a single bit test.
+
+ for (Int_t iw=0; iw<kNwords; iw++)
+ {
+  fAnyMask[iw]=0;
+ }
+
+ Int_t nvetos=fMasks.size()/kNwords;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  for (Int_t iw=0; iw<kNwords; iw++)
+  {
+   fAnyMask[iw]|=fMasks[isys*kNwords+iw];
+  }
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::CheckMasks()
+{
+// Check the consistency of the compiled veto DOM masks and parameters with the
+// registered veto systems and re-compile them if needed.
+// This is for instance needed when this IceVeto object was read from a file,
+// since the compiled veto systems are not persistent.
+
+ if (!IsCompiled()) CompileVetoSystems();
+}
+///////////////////////////////////////////////////////////////////////////
+Bool_t IceVeto::IsCompiled() const
+{
+// Indicate whether the compiled veto DOM masks and parameters are consistent
+// with the registered veto systems.
+
+ Int_t nvetos=0;
+ if (fVetos) nvetos=fVetos->GetEntries();
+
+ if (Int_t(fMasks.size())!=nvetos*kNwords || Int_t(fConfigs.size())!=nvetos) return kFALSE;
+ if (Int_t(fOrder.size())!=nvetos) return kFALSE;
+
+ return kTRUE;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::LoadConfig(Int_t isys)
+{
+// Compile the parameters of the veto system with array index "isys" into a typed
+// structure, such that they don't need to be retrieved by name for each event.
+// Also the prototype of the corresponding output device is (re)configured.
+
+ if (isys<0 || isys>=Int_t(fConfigs.size()) || !fVetos) return;
+
+ NcVeto* dveto=(NcVeto*)fVetos->At(isys);
+ if (!dveto) return;
+
+ IceVetoConfig& cfg=fConfigs[isys];
+
+ cfg.fQtotMin=dveto->GetSignal("QtotVetoMin");
+ cfg.fAmpMin=dveto->GetSignal("AmpVetoMin");
+ cfg.fNdomMin=dveto->GetSignal("NdomVetoMin");
+ cfg.fNhitMin=dveto->GetSignal("NhitVetoMin");
+ cfg.fSLC=dveto->GetSignal("SLCVeto");
+ cfg.fTresMin=dveto->GetSignal("TresVetoMin");
+ cfg.fTresMax=dveto->GetSignal("TresVetoMax");
+ cfg.fNvdoms=dveto->GetNhits();
+
+ // The hits used to determine the InIce center of gravity, central hit time and event start time
+ TString name=dveto->GetName();
+ cfg.fHitClass="IceIDOM";
+ if (name=="HESE86") cfg.fHitClass="IceICDOM";
+
+ // The prototype of the output device of this veto system, with the named slots already defined.
+ // This avoids the per-event construction of the device name.
+ NcVeto* proto=0;
+ if (isys<fProtos.GetSize()) proto=(NcVeto*)fProtos.UncheckedAt(isys);
+ if (!proto)
+ {
+  proto=new NcVeto(fOutput);
+  fProtos.AddAtAndExpand(proto,isys);
+ }
+ name=GetName();
+ name+="-";
+ name+=dveto->GetName();
+ proto->SetNameTitle(name.Data(),dveto->GetTitle());
+ proto->SetUniqueID(dveto->GetUniqueID());
+
+ UpdatePrototypes();
+
+ BuildRegions(isys);
+ OrderVetoSystems();
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::UpdatePrototypes()
+{
+// Update the prototypes of the output devices for the current record mode (see SetRecordMode)
+// and evaluation settings.
+// The "LowerBound" slot is only present in the prototypes when the observables may
+// represent lower bounds, i.e. for the decision-only evaluation (see SetDecisionOnly)
+// and the "any veto" policy (see SetAnyVeto).
+// A prototype from which the "LowerBound" slot has to be removed is re-created
+// from the template fOutput.
+
+ Int_t bound=0;
+ if (fDecision || fAnyVeto) bound=1;
+
+ NcVeto* proto=0;
+ NcVeto* old=0;
+ for (Int_t i=0; i<fProtos.GetSize(); i++)
+ {
+  proto=(NcVeto*)fProtos.UncheckedAt(i);
+  if (!proto) continue;
+
+  if (!bound && proto->GetSlotIndex("LowerBound"))
+  {
+   old=proto;
+   proto=new NcVeto(fOutput);
+   proto->SetNameTitle(old->GetName(),old->GetTitle());
+   proto->SetUniqueID(old->GetUniqueID());
+   fProtos.AddAt(proto,i);
+   delete old;
+  }
+
+  if (bound) proto->AddNamedSlot("LowerBound");
+
+  proto->SetHitCopy(0);
+  if (fRecord==kRecordCopy) proto->SetHitCopy(1);
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::BuildRegions(Int_t isys)
+{
+// Decompose the compiled veto DOM mask of the veto system with array index "isys"
+// into non-overlapping rectangular regions in the (string,DOM) plane.
+// For each string the consecutive veto DOMs form a DOM range, and identical DOM ranges
+// on consecutive strings are merged into a single region.
+
+ if (isys<0 || isys>=Int_t(fConfigs.size())) return;
+
+ if (Int_t(fRects.size())<Int_t(fConfigs.size())) fRects.resize(fConfigs.size());
+
+ std::vector<IceVetoRect>& rects=fRects[isys];
+ rects.clear();
+
+ std::vector<Int_t> open;  // The regions that may be extended to the next row
+ std::vector<Int_t> next;
+ ULong64_t word=0;
+ Int_t d1=0;
+ Int_t d2=0;
+ Int_t irect=0;
+ Int_t found=0;
+ for (Int_t iw=0; iw<kNwords; iw++)
+ {
+  next.clear();
+  word=fMasks[isys*kNwords+iw];
+  d1=0;
+  while (d1<kMaxDOM)
+  {
+   if (!((word>>d1)&1))
+   {
+    d1++;
+    continue;
+   }
+
+   // The DOM range [d1+1,d2+1] of this string
+   d2=d1;
+   while (d2+1<kMaxDOM && ((word>>(d2+1))&1)) d2++;
+
+   found=0;
+   for (Int_t i=0; i<Int_t(open.size()); i++)
+   {
+    irect=open[i];
+    if (rects[irect].fDom1==d1+1 && rects[irect].fDom2==d2+1)
+    {
+     rects[irect].fRow2=iw;
+     next.push_back(irect);
+     found=1;
+     break;
+    }
+   }
+
+   if (!found)
+   {
+    IceVetoRect rect;
+    rect.fRow1=iw;
+    rect.fRow2=iw;
+    rect.fDom1=d1+1;
+    rect.fDom2=d2+1;
+    rects.push_back(rect);
+    next.push_back(Int_t(rects.size())-1);
+   }
+
+   d1=d2+1;
+  }
+  open.swap(next);
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::OrderVetoSystems()
+{
+// Determine the order in which the veto systems are evaluated for the "any veto" policy
+// (see SetAnyVeto).
+// The veto systems with the loosest veto criteria (i.e. the ones most likely to veto
+// an event) are evaluated first, where the required number of DOMs, the required number
+// of hits and the required total signal amplitude are compared in that order.
+// In case of equal criteria, the veto system with the smallest number of veto DOMs
+// (i.e. the cheapest one) is evaluated first.
+// This implies that e.g. "IceTop86" is evaluated before "HESE86".
+
+ Int_t nvetos=fConfigs.size();
+
+ fOrder.resize(nvetos);
+ for (Int_t i=0; i<nvetos; i++)
+ {
+  fOrder[i]=i;
+ }
+
+ // Simple insertion sort, since the number of veto systems is limited
+ Int_t j=0;
+ Int_t isys=0;
+ for (Int_t i=1; i<nvetos; i++)
+ {
+  isys=fOrder[i];
+  j=i-1;
+  while (j>=0 && IsCheaper(fConfigs[isys],fConfigs[fOrder[j]]))
+  {
+   fOrder[j+1]=fOrder[j];
+   j--;
+  }
+  fOrder[j+1]=isys;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Bool_t IceVeto::IsCheaper(const IceVetoConfig& a,const IceVetoConfig& b) const
+{
+// Internal memberfunction to indicate whether the veto system with compiled parameters "a"
+// has to be evaluated before the one with the compiled parameters "b" for the "any veto" policy.
+
+ if (a.fNdomMin!=b.fNdomMin) return (a.fNdomMin<b.fNdomMin);
+ if (a.fNhitMin!=b.fNhitMin) return (a.fNhitMin<b.fNhitMin);
+ if (a.fQtotMin!=b.fQtotMin) return (a.fQtotMin<b.fQtotMin);
+ return (a.fNvdoms<b.fNvdoms);
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::CompileVetoSystems()
+{
+// (Re)build the compiled veto DOM masks and parameters of all the registered veto systems.
+// A compiled veto DOM mask is a fixed size bit pattern over the DOM lookup table
+// (see GetDOMIndex), which allows to test the membership of a DOM by a single bit lookup.
+// The veto DOMs and parameters of the NcVeto devices in fVetos remain the persistent
+// definition of the veto systems.
+//
+// Note : This memberfunction is invoked automatically when needed, but may also
+//        be invoked by the user after direct modification of the NcVeto devices.
+
+ Int_t nvetos=0;
+ if (fVetos) nvetos=fVetos->GetEntries();
+
+ fMasks.assign(nvetos*kNwords,0);
+ fConfigs.assign(nvetos,IceVetoConfig());
+ fProtos.Delete();
+
+ NcVeto* dveto=0;
+ NcSignal* vdom=0;
+ Int_t index=0;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  dveto=(NcVeto*)fVetos->At(isys);
+  if (!dveto) continue;
+
+  for (Int_t ivdom=1; ivdom<=dveto->GetNhits(); ivdom++)
+  {
+   vdom=dveto->GetHit(ivdom);
+   if (!vdom) continue;
+
+   index=GetDOMIndex(Int_t(vdom->GetUniqueID()));
+   SetVetoDOM(isys,index,1);
+  }
+
+  LoadConfig(isys);
+ }
+
+ UpdateAnyMask();
+}
+///////////////////////////////////////////////////////////////////////////
+IceVetoRef* IceVeto::GetReference(IceEvent* evt,const TString& classname,Int_t slc,IceVetoScratch& w) const
+{
+// Provide the reference quantities of the event for the hits of the specified class
+// and SLC selection mode (see NcEvent::GetHits).
+// The center of gravity, central hit time, total signal amplitude, time ordered hits
+// and the event start time (and position) are determined only once per event for
+// each different hit selection, and are subsequently provided from the cache in the work space "w".
+// This implies that the time ordering etc. of the hits is not repeated for each veto system.
+// The total signal amplitude and the event start time are obtained from the
+// calibrated hit data of the event (see CacheHits).
+//
+// In case of inconsistency a value 0 will be returned.
+
+ if (!evt) return 0;
+
+ // Check whether these reference quantities are already available for this event
+ for (Int_t i=0; i<w.fNrefs; i++)
+ {
+  if (w.fRefs[i].fSLC==slc && w.fRefs[i].fClass==classname) return &w.fRefs[i];
+ }
+
+ if (w.fNrefs>=kMaxRefs)
+ {
+  cout << " *IceVeto::GetReference* Maximum number of hit selections (" << kMaxRefs << ") exceeded." << endl;
+  return 0;
+ }
+
+ IceVetoRef* ref=&w.fRefs[w.fNrefs];
+ w.fNrefs++;
+
+ if (ref->fClass!=classname) ref->fClass=classname; // Avoid re-allocation of the string for each event
+ ref->fSLC=slc;
+ ref->fHits.Clear();
+ ref->fOrdered.Clear();
+
+ evt->GetHits(classname,&ref->fHits,"SLC",slc);
+
+ ref->fR0=evt->GetCOG(&ref->fHits,1,"ADC",8);
+ ref->fT0=evt->GetCVAL(&ref->fHits,"LE","ADC",8);
+ ref->fQtot=LoadReferenceHits(ref,w);
+ for (Int_t i=0; i<3; i++)
+ {
+  ref->fX0[i]=ref->fR0.GetX(i+1,"car");
+ }
+
+ Double_t thres=0.05*ref->fQtot; // Signal threshold to determine the event start time
+ if (thres<3) thres=3;
+ Double_t twin=3000;             // Time window size to determine the event start time
+ ref->fTstart=GetStartTime(ref,thres,twin,w);
+
+ // Get the position of the event start signal
+ for (Int_t i=0; i<3; i++)
+ {
+  ref->fXstart[i]=0;
+ }
+ if (ref->fI2>=0)
+ {
+  NcSignal* sx=(NcSignal*)ref->fOrdered.At(ref->fI2);
+  NcDevice* omx=0;
+  if (sx) omx=sx->GetDevice();
+  if (omx)
+  {
+   const Double_t* pos=GetDOMPosition(GetDOMIndex(Int_t(omx->GetUniqueID())),omx,w);
+   for (Int_t i=0; i<3; i++)
+   {
+    ref->fXstart[i]=pos[i];
+   }
+  }
+ }
+
+ return ref;
+}
+///////////////////////////////////////////////////////////////////////////
+Double_t IceVeto::LoadReferenceHits(IceVetoRef* ref,IceVetoScratch& w) const
+{
+// Copy the calibrated "LE" times (together with the hit indices) and "ADC" amplitudes
+// of the hits of the reference hit selection "ref" into the flat arrays of the
+// work space "w", as needed by GetStartTime().
+// The values are obtained from the calibrated hit data of the event (see CacheHits),
+// and only for hits which are not present there, they are obtained from the hit itself.
+//
+// Hits of which the "LE" signal is marked dead are not copied into the array of hit times,
+// like the hits that are skipped by NcDevice::SortHits() with deadcheck=1.
+// This implies that these hits don't contribute to the event start time and don't
+// appear in the time ordered hits (see GetStartTime).
+//
+// Also the number of different DOMs of the hits is provided in ref->fNdom.
+//
+// The return argument is the total signal amplitude of the hits, which is
+// the same as provided by NcDevice::SumSignals("ADC",8).
+
+ w.fNtimes=0;
+ ref->fNdom=0;
+
+ Int_t nhits=ref->fHits.GetEntries();
+ if (nhits>Int_t(w.fTimes.size()))
+ {
+  w.fTimes.resize(2*nhits);
+  w.fWeights.resize(2*nhits);
+  w.fAmps.resize(2*nhits);
+ }
+
+ Double_t qtot=0;
+ NcSignal* sx=0;
+ NcDevice* omx=0;
+ NcDevice* lastomx=0;
+ Int_t jcache=0;
+ Double_t le=0;
+ Float_t adc=0;
+ Int_t dead=0;
+ for (Int_t i=0; i<nhits; i++)
+ {
+  w.fAmps[i]=0;
+
+  sx=(NcSignal*)ref->fHits.At(i);
+  if (!sx) continue;
+
+  // The hits of a DOM are provided consecutively by NcEvent::GetHits()
+  omx=sx->GetDevice();
+  if (omx!=lastomx) ref->fNdom++;
+  lastomx=omx;
+
+  jcache=GetCachedHit(sx,w);
+  if (jcache>=0)
+  {
+   le=w.fCle[jcache];
+   adc=w.fCadc[jcache];
+   dead=w.fCdead[jcache];
+  }
+  else
+  {
+   le=sx->GetSignal("LE",8);
+   adc=sx->GetSignal("ADC",8);
+   dead=sx->GetDeadValue("LE");
+  }
+
+  w.fAmps[i]=adc;
+  qtot+=adc;
+
+  if (dead) continue;
+
+  w.fTimes[w.fNtimes].first=le;
+  w.fTimes[w.fNtimes].second=i;
+  w.fNtimes++;
+ }
+
+ return qtot;
+}
+///////////////////////////////////////////////////////////////////////////
+Double_t IceVeto::GetStartTime(IceVetoRef* ref,Double_t thres,Double_t twin,IceVetoScratch& w) const
+{
+// Determine the event start time for the hits of the reference hit selection "ref".
+// The result corresponds to NcDevice::SortHits() with deadcheck=1 followed by NcDevice::SlideWindow()
+// for the (calibrated) "LE" times and "ADC" amplitudes, i.e. the start time of the
+// first time window of size "twin" in which the accumulated amplitude reaches
+// the threshold "thres".
+// Like for SortHits() with deadcheck=1, the hits with a dead "LE" signal are not taken
+// into account (see LoadReferenceHits).
+// Also the time ordered hits and the indices of the first (ref->fI1) and last (ref->fI2)
+// hit of the start window are provided in "ref".
+//
+// The hit times, as copied into a flat array by LoadReferenceHits() together with the hit indices,
+// are sorted by a standard (introspective) sort of these primitive values.
+// Equal hit times are kept in the original hit order. Since the ordering of equal hit times
+// by NcDevice::SortHits() is not specified, in case of equal hit times the start window
+// indices (and the start position) may refer to another one of these hits, whereas
+// the start time itself is not affected.
+// The start window is then obtained by a single two-pointer scan over the
+// time ordered amplitudes, since for non-negative amplitudes the last hit that is needed
+// to reach the threshold never moves backward when the window start moves forward.
+// This replaces the sorting of the hit objects and the window scan requiring
+// repeated (virtual) signal access for each window start.
+//
+// In case negative amplitudes are encountered or no window reaches the threshold,
+// the result is obtained via NcDevice::SlideWindow() on the time ordered hits.
+
+ ref->fI1=-1;
+ ref->fI2=-1;
+ ref->fOrdered.Clear();
+
+ // Sort the hit times as stored by LoadReferenceHits() in increasing order
+ Int_t n=w.fNtimes;
+ std::sort(w.fTimes.begin(),w.fTimes.begin()+n);
+
+ // Store the time ordered hits and their amplitudes
+ NcSignal* sx=0;
+ Int_t negative=0;
+ for (Int_t j=0; j<n; j++)
+ {
+  sx=(NcSignal*)ref->fHits.At(w.fTimes[j].second);
+  ref->fOrdered.Add(sx);
+  w.fWeights[j]=w.fAmps[w.fTimes[j].second];
+  if (w.fWeights[j]<0) negative=1;
+ }
+
+ // Two-pointer scan for the first window that reaches the threshold
+ if (!negative)
+ {
+  const std::pair<Double_t,Int_t>* t=w.fTimes.data();
+  const Double_t* a=w.fWeights.data();
+  Double_t sum=0; // The accumulated amplitude of the hits [jstart,jstop-1]
+  Int_t jstop=0;
+  for (Int_t jstart=0; jstart<n; jstart++)
+  {
+   if (jstop<jstart)
+   {
+    jstop=jstart;
+    sum=0;
+   }
+
+   while (jstop<n && (t[jstop].first-t[jstart].first)<=twin)
+   {
+    if ((sum+a[jstop])>=thres)
+    {
+     ref->fI1=jstart;
+     ref->fI2=jstop;
+     return t[jstart].first;
+    }
+    sum+=a[jstop];
+    jstop++;
+   }
+
+   if (jstop>jstart) sum-=a[jstart];
+  }
+ }
+
+ NcDevice& dum=w.fWork;
+ return dum.SlideWindow(&ref->fOrdered,thres,twin,"LE",8,"ADC",8,&ref->fI1,&ref->fI2);
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::Exec(Option_t* opt)
+{
+// Implementation of the (self)vetoing procedure.
+
+ NcJob* parent=(NcJob*)(gROOT->GetListOfTasks()->FindObject(opt));
 
  if (!parent) return;
 
- IceEvent* evt=(IceEvent*)parent->GetObject("IceEvent");
- if (!evt) return;
+ IceEvent* evt=(IceEvent*)parent->GetObject("IceEvent");
+ if (!evt) return;
+
+ // Make sure that the compiled veto systems are up to date
+ CheckMasks();
+
+ Int_t eval=Evaluate(evt,fResult,GetExecScratch());
+
+ if (fTree) FillResultTree(evt,eval,fResult);
+
+ // Mark the events that were rejected by the pre-veto gate
+ if (fResult.fGated) StoreGate(evt,fResult);
+
+ if (!eval) return;
+
+ if (fScan.size()) ScanEvent(evt,*fScratch);
+
+ StoreResult(evt,fResult,fScratch);
+}
+///////////////////////////////////////////////////////////////////////////
+IceVetoScratch* IceVeto::GetExecScratch()
+{
+// Provide the work space for the event processing via Exec() and ProcessBatch().
+// The work space (and the capacities of the veto result) are only allocated
+// at the first invokation, so that IceVeto objects that are only created
+// for I/O purposes (e.g. by the ROOT streamer) don't allocate the memory
+// of a work space.
+
+ if (fScratch) return fScratch;
+
+ fScratch=new IceVetoScratch();
+ fResult.fSys.reserve(IceVetoScratch::kMaxSystems);
+ fResult.fHits.reserve(IceVetoScratch::kMaxHits);
+ fResult.fHitSys.reserve(IceVetoScratch::kMaxHits);
+
+ return fScratch;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::Evaluate(IceEvent* evt,IceVetoResult& res) const
+{
+// Evaluate the veto systems for the event "evt" and provide the outcome in "res".
+// This memberfunction uses the work space of the current thread as provided by GetScratch().
+// See the other Evaluate() memberfunction for further details.
+
+ return Evaluate(evt,res,GetScratch());
+}
+///////////////////////////////////////////////////////////////////////////
+IceVetoScratch* IceVeto::GetScratch() const
+{
+// Provide the work space owned by this IceVeto object for the current thread.
+// The work space is created at the first invokation from a certain thread
+// and is subsequently re-used, i.e. it is reset instead of re-allocated for each event.
+// The work space of the current thread is cached in thread local storage,
+// so the registration of the work spaces is only accessed at the first invokation
+// from a certain thread.
+// The work space of a thread is released (see ReleaseScratch) when the thread exits,
+// and the remaining work spaces are deleted together with this IceVeto object.
+// So, also in case threads are created and terminated repeatedly, the memory of the
+// work spaces doesn't grow beyond the number of simultaneously active threads.
+// For worker threads that only live during a certain processing, a work space
+// may also be obtained via CreateScratch() and released via ReleaseScratch()
+// when the thread has finished, as is done by ProcessMT() and ProcessPipeline().
+//
+// The internal arrays of a work space keep their capacities, such that for re-used
+// work spaces the processing by IceVeto itself doesn't perform heap allocations.
+// The hit selection and reference quantities are however obtained via NCFS facilities
+// (i.e. NcEvent::GetDevices, NcEvent::GetHits, NcEvent::GetCOG and NcEvent::GetCVAL),
+// of which the memory allocations are not under control of IceVeto.
+// So, the heap allocations of Evaluate() for an event are limited to those of the above
+// NCFS invokations, which is verified by the allocation check of the macro check.cc.
+
+ // The thread local cache, which is identified by the unique serial number of this IceVeto object
+ static thread_local Long64_t tSerial=0;
+ static thread_local IceVetoScratch* tScratch=0;
+ if (tScratch && tSerial==fSerial) return tScratch;
+
+ std::thread::id id=std::this_thread::get_id();
+
+ {
+  std::lock_guard<std::mutex> live(gIceVetoLiveMutex);
+  gIceVetoLive[fSerial]=this;
+ }
+
+ std::lock_guard<std::mutex> lock(fPool->fMutex);
+
+ IceVetoScratch* scratch=0;
+ for (Int_t i=0; i<Int_t(fPool->fIds.size()); i++)
+ {
+  if (fPool->fIds[i]==id) scratch=fPool->fScratches[i];
+ }
+
+ if (!scratch)
+ {
+  scratch=new IceVetoScratch();
+  fPool->fScratches.push_back(scratch);
+  fPool->fIds.push_back(id);
+
+  // Register the work space for its release at thread exit
+  static thread_local IceVetoThreadScratches tExit;
+  tExit.fSerials.push_back(fSerial);
+  tExit.fScratches.push_back(scratch);
+ }
+
+ tSerial=fSerial;
+ tScratch=scratch;
+ return scratch;
+}
+///////////////////////////////////////////////////////////////////////////
+IceVetoScratch* IceVeto::CreateScratch() const
+{
+// Create a work space for the evaluation of events (see Evaluate) by a single thread.
+// In contrast to GetScratch(), the work space is not registered with a thread,
+// and it has to be released via ReleaseScratch() when it is not needed anymore.
+
+ return new IceVetoScratch();
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ReleaseScratch(IceVetoScratch* scratch) const
+{
+// Delete the work space "scratch" as obtained via CreateScratch().
+// Note : The per-thread work spaces as provided by GetScratch() are owned by this IceVeto object
+//        and may not be released via this memberfunction.
+// The timing and counter statistics (see SetInstrumentation) of the work space
+// are retained, so they remain available via GetStats() and Data(3).
+
+ if (!scratch) return;
+
+ {
+  std::lock_guard<std::mutex> lock(fPool->fMutex);
+
+  if (fDoneStats.size()<scratch->fStats.size()) fDoneStats.resize(scratch->fStats.size());
+  for (Int_t j=0; j<Int_t(scratch->fStats.size()); j++)
+  {
+   IceVetoAddStats(fDoneStats[j],scratch->fStats[j]);
+  }
+  for (Int_t j=0; j<kNstages; j++)
+  {
+   IceVetoAddStats(fDoneStages[j],scratch->fStages[j]);
+  }
+ }
+
+ delete scratch;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ResetGeometry()
+{
+// Reset the DOM geometry tables of all the work spaces of this IceVeto object,
+// such that the DOM positions are obtained again from the events (see GetDOMPosition).
+// This is only needed when events with a different detector geometry are processed.
+
+ std::lock_guard<std::mutex> lock(fPool->fMutex);
+
+ for (Int_t i=0; i<=Int_t(fPool->fScratches.size()); i++)
+ {
+  IceVetoScratch* w=fScratch;
+  if (i<Int_t(fPool->fScratches.size())) w=fPool->fScratches[i];
+  if (!w) continue;
+
+  for (Int_t j=0; j<kNdomIndex; j++)
+  {
+   w->fGeoSet[j]=0;
+  }
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::Evaluate(IceEvent* evt,IceVetoResult& res,IceVetoScratch* scratch) const
+{
+// Evaluate the veto systems for the event "evt" and provide the outcome in "res".
+// All the temporary data of the evaluation reside in the work space "scratch",
+// whereas the veto system definitions are only read.
+// This implies that this memberfunction may be invoked simultaneously from several
+// threads, provided that each thread uses its own work space and event.
+// Also the event itself is not modified, and no access to the global task list
+// is needed, in contrast to Exec().
+// The outcome may be stored in the event afterwards via StoreResult().
+//
+// The return argument is 1 if the event was evaluated and 0 otherwise.
+//
+// Note : The veto systems have to be compiled before invokation, which is
+//        automatically done by Exec() or ProcessMT(), and can be enforced
+//        via CompileVetoSystems().
+
+ res.fVetoLevel=0;
+ res.fSys.clear();
+ res.fHits.clear();
+ res.fHitSys.clear();
+ res.fGated=0;
+ res.fGateQtot=0;
+ res.fGateNdom=0;
+
+ if (!evt || !scratch || !fVetos) return 0;
+
+ if (!IsCompiled())
+ {
+  cout << " *IceVeto::Evaluate* Veto systems not compiled. Invoke CompileVetoSystems() first." << endl;
+  return 0;
+ }
+
+ // Only process accepted events
+ NcDevice* seldev=evt->GetDevice("NcEventSelector");
+ if (seldev)
+ {
+  if (seldev->GetSignal("Select") < 0.1) return 0;
+ }
+
+ // The number of all OMs with a signal in the event
+ Int_t nmods=evt->GetNdevices("IceGOM");
+ if (!nmods) return 0;
+
+ // The light speed in m/ns
+ Double_t c=fSpeedC;
+
+ IceVetoScratch& w=*scratch;
+
+ // Invalidate the reference quantities of the previous event
+ w.fNrefs=0;
+
+ Double_t tclock=0;
+ if (fInstrument) tclock=IceVetoClock();
+
+ // Index the fired DOMs of this event and store their hits in contiguous arrays
+ IndexDOMs(evt,w);
+
+ // Apply the pre-veto gate to skip the evaluation of low signal events
+ if (fGateQtot>0 || fGateNdom>0)
+ {
+  if (!PassGate(evt,w,res))
+  {
+   res.fGated=1;
+   w.fNhits=0;
+   if (fInstrument)
+   {
+    w.fStages[kStageIndex].fEvents++;
+    w.fStages[kStageIndex].fDoms+=w.fNfired;
+    w.fStages[kStageIndex].fEarly++;
+    IceVetoLap(w.fStages[kStageIndex],tclock);
+   }
+   return 0;
+  }
+ }
+
+ FlattenHits(w);
+ w.fNsum=0;
+
+ Int_t nvetos=fVetos->GetEntries();
+ if (Int_t(w.fSys.size())<nvetos) w.fSys.resize(nvetos);
+ res.fSys.resize(nvetos);
+
+ if (fInstrument)
+ {
+  if (Int_t(w.fStats.size())<nvetos) w.fStats.resize(nvetos);
+  w.fStages[kStageIndex].fEvents++;
+  w.fStages[kStageIndex].fDoms+=w.fNfired;
+  w.fStages[kStageIndex].fHits+=w.fNhits;
+  tclock=IceVetoLap(w.fStages[kStageIndex],tclock);
+ }
+
+ // Obtain the reference quantities for each veto system
+ IceVetoSys* vsys=0;
+ const IceVetoConfig* cfg=0;
+ IceVetoRef* ref=0;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  vsys=&w.fSys[isys];
+  vsys->fCfg=0;
+  vsys->fRef=0;
+  vsys->fIref=0;
+  vsys->fActive=0;
+  vsys->fParams=0;
+  vsys->fQtot=0;
+  vsys->fNdom=0;
+  vsys->fNhit=0;
+  vsys->fVetoHit=0;
+  vsys->fDone=0;
+  vsys->fRegion=0;
+  vsys->fStop=-1;
+
+  if (!fVetos->At(isys)) continue;
+
+  cfg=&fConfigs[isys];
+
+  // Obtain the InIce center of gravity, central hit time and event start time.
+  // For the "any veto" policy these are obtained only when the veto system is evaluated.
+  if (!fAnyVeto)
+  {
+   ref=GetReference(evt,cfg->fHitClass,-2,w);
+   if (!ref) continue;
+   vsys->fRef=ref;
+   vsys->fIref=ref-w.fRefs;
+  }
+
+  vsys->fCfg=cfg;
+  vsys->fActive=1;
+ }
+
+ if (fInstrument)
+ {
+  w.fStages[kStageReference].fEvents++;
+  tclock=IceVetoLap(w.fStages[kStageReference],tclock);
+ }
+
+ // Collect the veto hits of the various veto systems
+ Double_t tsys=0;
+ if (fAnyVeto)
+ {
+  for (Int_t iorder=0; iorder<nvetos && iorder<Int_t(fOrder.size()); iorder++)
+  {
+   Int_t isys=fOrder[iorder];
+   vsys=&w.fSys[isys];
+   if (!vsys->fActive) continue;
+
+   ref=GetReference(evt,vsys->fCfg->fHitClass,-2,w);
+   if (!ref) continue;
+
+   vsys->fRef=ref;
+   vsys->fIref=ref-w.fRefs;
+   if (fInstrument) tsys=IceVetoClock();
+   EvaluateSystem(isys,c,w,res);
+   if (fInstrument) IceVetoLap(w.fStats[isys],tsys);
+
+   // Stop at the first veto system that vetoes the event
+   if (IsVetoed(vsys))
+   {
+    if (fInstrument && iorder<nvetos-1) w.fStages[kStageVeto].fEarly++;
+    break;
+   }
+  }
+ }
+ else if (fFused)
+ {
+  // The veto systems that qualify for the region summary are excluded from the single pass
+  for (Int_t isys=0; isys<nvetos; isys++)
+  {
+   EvaluateRegion(isys,w);
+  }
+  EvaluateFused(nvetos,c,w,res);
+ }
+ else
+ {
+  for (Int_t isys=0; isys<nvetos; isys++)
+  {
+   if (fInstrument) tsys=IceVetoClock();
+   EvaluateSystem(isys,c,w,res);
+   if (fInstrument) IceVetoLap(w.fStats[isys],tsys);
+  }
+ }
+
+ if (fInstrument)
+ {
+  w.fStages[kStageVeto].fEvents++;
+  IceVetoLap(w.fStages[kStageVeto],tclock);
+  // The hit counters were accumulated during the evaluation
+  for (Int_t isys=0; isys<nvetos; isys++)
+  {
+   vsys=&w.fSys[isys];
+   if (!vsys->fActive || !vsys->fRef || !vsys->fCfg) continue;
+   w.fStats[isys].fEvents++;
+   if (vsys->fRegion) w.fStats[isys].fRegions++;
+   if (vsys->fStop>=0) w.fStats[isys].fEarly++;
+  }
+ }
+
+ // Determine the veto level of each veto system and the overall veto level
+ IceVetoSysResult* sres=0;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  vsys=&w.fSys[isys];
+  sres=&res.fSys[isys];
+
+  sres->fStatus=0;
+  sres->fNdom=vsys->fNdom;
+  sres->fNhit=vsys->fNhit;
+  sres->fQtot=vsys->fQtot;
+  sres->fLevel=0;
+  sres->fLowerBound=vsys->fDone;
+
+  if (!vsys->fActive) continue;
+
+  sres->fStatus=1;
+  if (!vsys->fRef) // Veto system not evaluated
+  {
+   sres->fStatus=-1;
+   sres->fLevel=-1;
+   sres->fLowerBound=1;
+  }
+  else if (IsVetoed(vsys))
+  {
+   sres->fLevel=1;
+   res.fVetoLevel+=1;
+  }
+ }
+
+ return 1;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::StoreResult(IceEvent* evt,IceVetoResult& res,IceVetoScratch* scratch) const
+{
+// Store the veto result "res" as obtained via Evaluate() in the event "evt".
+// For each veto system an output device "IceVeto-<system>" is created, which contains
+// the veto parameters, the observables and the veto level of the veto system,
+// together with the recorded veto hits (see SetRecordMode).
+// The overall veto level is entered in the event structure via NcVeto::StoreVetoLevel().
+// The work space "scratch" has to be the one that was used for Evaluate().
+//
+// Note : The output devices are stored as private copies of the prototypes owned
+//        by this IceVeto object, which requires the DevCopy mode of the event
+//        to be active (see NcEvent::SetDevCopy).
+//        For an event with DevCopy mode 0 the event would only store the pointers
+//        to the prototypes, so in that case nothing is stored and a warning is printed.
+
+ if (!evt || !scratch) return;
+
+ if (!evt->GetDevCopy())
+ {
+  static std::atomic<Int_t> warned(0);
+  if (!warned.exchange(1))
+  {
+   cout << " *IceVeto::StoreResult* Event with DevCopy mode 0 : No veto results stored." << endl;
+   cout << " Activate the DevCopy mode via NcEvent::SetDevCopy(1) before any device is added to the event." << endl;
+  }
+  return;
+ }
+
+ IceVetoScratch& w=*scratch;
+
+ Double_t tclock=0;
+ if (fInstrument) tclock=IceVetoClock();
+
+ Int_t nvetos=res.fSys.size();
+ if (Int_t(w.fSys.size())<nvetos || Int_t(fConfigs.size())<nvetos) return;
+
+ const IceVetoConfig* cfg=0;
+ const IceVetoSysResult* sres=0;
+ NcVeto* proto=0;
+ NcVeto* params=0;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  w.fSys[isys].fParams=0;
+
+  sres=&res.fSys[isys];
+  if (!sres->fStatus) continue;
+
+  proto=0;
+  if (isys<fProtos.GetSize()) proto=(NcVeto*)fProtos.UncheckedAt(isys);
+  if (!proto) continue;
+
+  // Store a copy of the output device prototype in the event (DevCopy mode checked above).
+  // The stored copy is the last device of the event, so no lookup by name is needed.
+  evt->AddDevice(*proto);
+  params=(NcVeto*)evt->GetDevice(evt->GetNdevices());
+  if (!params || params==proto) continue;
+
+  w.fSys[isys].fParams=params;
+
+  cfg=&fConfigs[isys];
+
+  // Add values of observables and veto level to the parameters of this veto system
+  params->SetSignal(cfg->fSLC,fSlots[kSLCVeto]);
+  params->SetSignal(cfg->fAmpMin,fSlots[kAmpVetoMin]);
+  params->SetSignal(cfg->fNdomMin,fSlots[kNdomVetoMin]);
+  params->SetSignal(cfg->fNhitMin,fSlots[kNhitVetoMin]);
+  params->SetSignal(cfg->fQtotMin,fSlots[kQtotVetoMin]);
+  params->SetSignal(cfg->fTresMin,fSlots[kTresVetoMin]);
+  params->SetSignal(cfg->fTresMax,fSlots[kTresVetoMax]);
+  params->SetSignal(sres->fNdom,fSlots[kNdomVeto]);
+  params->SetSignal(sres->fNhit,fSlots[kNhitVeto]);
+  params->SetSignal(sres->fQtot,fSlots[kQtotVeto]);
+  params->SetSignal(sres->fLevel,fSlots[kVetoLevel]);
+  if (fDecision || fAnyVeto) params->SetSignal(sres->fLowerBound,fSlots[kLowerBound]);
+
+  if (fVerbose)
+  {
+   cout << " *IceVeto::Exec* " << params->GetName() << " NdomVeto:" << sres->fNdom
+        << " NhitVeto:" << sres->fNhit << " QtotVeto:" << sres->fQtot << " VetoLevel:" << sres->fLevel << endl;
+  }
+ }
+
+ // Record the veto hits in the corresponding output devices
+ Int_t isys=0;
+ for (Int_t ihit=0; ihit<Int_t(res.fHits.size()); ihit++)
+ {
+  isys=res.fHitSys[ihit];
+  if (isys<0 || isys>=nvetos) continue;
+  params=w.fSys[isys].fParams;
+  if (params) params->AddHit(res.fHits[ihit]);
+ }
+
+ // Enter the final overall veto level into the event structure
+ w.fWork.StoreVetoLevel(evt,res.fVetoLevel);
+
+ if (fInstrument)
+ {
+  w.fStages[kStageOutput].fEvents++;
+  IceVetoLap(w.fStages[kStageOutput],tclock);
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::EvaluateSystem(Int_t isys,Double_t c,IceVetoScratch& w,IceVetoResult& res) const
+{
+// Collect the veto hits of the veto system with array index "isys" for the current event.
+// The single hit veto criteria are applied to all the hits of the fired veto DOMs
+// as stored by FlattenHits(), after which the accepted hits of the veto DOMs of
+// this veto system are accumulated.
+// The light speed "c" has to be provided in m/ns.
+
+ IceVetoSys* vsys=&w.fSys[isys];
+ IceVetoRef* ref=vsys->fRef;
+ const IceVetoConfig* cfg=vsys->fCfg;
+ if (!vsys->fActive || !ref || !cfg) return;
+
+ if (EvaluateRegion(isys,w)) return;
+
+ CutHits(cfg,ref,c,w);
+
+ // The counter statistics (see SetInstrumentation)
+ IceVetoStats* st=0;
+ if (fInstrument) st=&w.fStats[isys];
+
+ Int_t index=0;
+ Int_t lastindex=-1;
+
+ // Loop over all the hits of the fired veto DOMs of the event
+ vsys->fVetoHit=0;
+ for (Int_t jhit=0; jhit<w.fNhits; jhit++)
+ {
+  // The rejected hits are only inspected for the counter statistics
+  if (!w.fHpass[jhit] && !st) continue;
+
+  index=w.fHdom[jhit];
+
+  // Check if this fired DOM is a veto DOM of this veto system
+  if (!IsVetoDOM(isys,index)) continue;
+
+  // Count the previous DOM when it contained a veto hit
+  if (index!=lastindex)
+  {
+   if (vsys->fVetoHit) vsys->fNdom++;
+   vsys->fVetoHit=0;
+   lastindex=index;
+   if (st) st->fDoms++;
+  }
+
+  // Classify the hit according to the first veto criterion by which it was rejected
+  if (st)
+  {
+   st->fHits++;
+   if (!w.fHpass[jhit])
+   {
+    if (!cfg->fSLC && w.fHslc[jhit])
+    {
+     st->fRejSLC++;
+    }
+    else if (w.fHadc[jhit]<cfg->fAmpMin)
+    {
+     st->fRejAmp++;
+    }
+    else
+    {
+     st->fRejTres++;
+    }
+    continue;
+   }
+   st->fVetoHits++;
+  }
+
+#ifdef ICEVETO_DIAGNOSTICS
+  if (fVerbose>1) ShowVetoHit(jhit,ref,c,w);
+#endif
+
+  // Valid veto hit encountered
+  vsys->fVetoHit=1;
+  vsys->fQtot+=w.fHadc[jhit];
+  vsys->fNhit++;
+  if (fRecord!=kRecordCount)
+  {
+   res.fHits.push_back(w.fHsig[jhit]);
+   res.fHitSys.push_back(isys);
+  }
+
+  // Stop the evaluation when only the veto decision is requested and the criteria are met
+  if ((fDecision || fAnyVeto) && IsVetoed(vsys))
+  {
+   vsys->fNdom++;
+   vsys->fVetoHit=0;
+   vsys->fDone=1;
+   vsys->fStop=jhit;
+   return;
+  }
+ } // End of loop over the hits
+
+ if (vsys->fVetoHit) vsys->fNdom++;
+ vsys->fVetoHit=0;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::EvaluateFused(Int_t nvetos,Double_t c,IceVetoScratch& w,IceVetoResult& res) const
+{
+// Collect the veto hits of all the veto systems for the current event
+// in a single pass over the hits of the fired veto DOMs as stored by FlattenHits().
+// For each fired DOM the veto systems it belongs to are obtained from the
+// compiled veto DOM masks, after which each hit of the DOM is tested
+// against the selection criteria of each of these veto systems.
+// This provides the same veto hits as EvaluateSystem() for each veto system.
+// The light speed "c" has to be provided in m/ns.
+
+ if (Int_t(w.fMembers.size())<nvetos) w.fMembers.resize(nvetos);
+
+ IceVetoSys* vsys=0;
+ const IceVetoConfig* cfg=0;
+ IceVetoStats* st=0;
+ Double_t dist0[kMaxRefs]; // Distance of the DOM to the reference position of each hit selection
+ Double_t dx=0;
+ Double_t dy=0;
+ Double_t dz=0;
+ Double_t tx=0;
+ Float_t amp=0;
+ Int_t slchit=0;
+ Double_t tres0=0;
+ Int_t index=0;
+ Int_t lastindex=-1;
+ Int_t nmem=0;
+ Int_t isys=0;
+
+ // The number of veto systems which still need to be evaluated
+ Int_t nopen=0;
+ for (isys=0; isys<nvetos; isys++)
+ {
+  if (w.fSys[isys].fActive && !w.fSys[isys].fRegion) nopen++;
+ }
+
+ // Loop over all the hits of the fired veto DOMs of the event
+ for (Int_t jhit=0; jhit<w.fNhits; jhit++)
+ {
+  index=w.fHdom[jhit];
+
+  // Collect the veto systems to which a newly encountered DOM belongs
+  if (index!=lastindex)
+  {
+   for (Int_t imem=0; imem<nmem; imem++)
+   {
+    vsys=&w.fSys[w.fMembers[imem]];
+    if (vsys->fVetoHit) vsys->fNdom++;
+    vsys->fVetoHit=0;
+   }
+
+   if (!nopen) break;
+
+   lastindex=index;
+   nmem=0;
+   for (isys=0; isys<nvetos; isys++)
+   {
+    if (!w.fSys[isys].fActive || w.fSys[isys].fDone || w.fSys[isys].fRegion || !IsVetoDOM(isys,index)) continue;
+    w.fSys[isys].fVetoHit=0;
+    w.fMembers[nmem]=isys;
+    nmem++;
+    if (fInstrument) w.fStats[isys].fDoms++;
+   }
+
+   for (Int_t iref=0; iref<w.fNrefs; iref++)
+   {
+    dx=w.fHx[jhit]-w.fRefs[iref].fX0[0];
+    dy=w.fHy[jhit]-w.fRefs[iref].fX0[1];
+    dz=w.fHz[jhit]-w.fRefs[iref].fX0[2];
+    dist0[iref]=sqrt(dx*dx+dy*dy+dz*dz);
+   }
+  }
+
+  if (!nmem) continue;
+
+  slchit=w.fHslc[jhit];
+  amp=w.fHadc[jhit];
+  tx=w.fHle[jhit];
+
+  // Test this hit against the criteria of each of the corresponding veto systems
+  for (Int_t imem=0; imem<nmem; imem++)
+  {
+   isys=w.fMembers[imem];
+   vsys=&w.fSys[isys];
+   if (vsys->fDone) continue;
+
+   cfg=vsys->fCfg;
+
+   // The counter statistics (see SetInstrumentation)
+   st=0;
+   if (fInstrument)
+   {
+    st=&w.fStats[isys];
+    st->fHits++;
+   }
+
+   if (!cfg->fSLC && slchit)
+   {
+    if (st) st->fRejSLC++;
+    continue;
+   }
+
+   if (amp<cfg->fAmpMin)
+   {
+    if (st) st->fRejAmp++;
+    continue;
+   }
+
+   if (cfg->fTresMin<=cfg->fTresMax)
+   {
+    tres0=(tx-vsys->fRef->fT0)-(dist0[vsys->fIref]/c);
+    if (tres0<cfg->fTresMin || tres0>cfg->fTresMax)
+    {
+     if (st) st->fRejTres++;
+     continue;
+    }
+   }
+
+   if (st) st->fVetoHits++;
+
+#ifdef ICEVETO_DIAGNOSTICS
+   if (fVerbose>1) ShowVetoHit(jhit,vsys->fRef,c,w);
+#endif
+
+   // Valid veto hit encountered
+   vsys->fVetoHit=1;
+   vsys->fQtot+=amp;
+   vsys->fNhit++;
+   if (fRecord!=kRecordCount)
+   {
+    res.fHits.push_back(w.fHsig[jhit]);
+    res.fHitSys.push_back(isys);
+   }
+
+   // Stop the evaluation of this veto system when only the veto decision is requested and the criteria are met
+   if (fDecision && IsVetoed(vsys))
+   {
+    vsys->fNdom++;
+    vsys->fVetoHit=0;
+    vsys->fDone=1;
+    vsys->fStop=jhit;
+    nopen--;
+   }
+  }
+
+  if (!nopen) break;
+ } // End of loop over the hits
+
+ for (Int_t imem=0; imem<nmem; imem++)
+ {
+  vsys=&w.fSys[w.fMembers[imem]];
+  if (vsys->fVetoHit) vsys->fNdom++;
+  vsys->fVetoHit=0;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ShowVetoHit(Int_t jhit,IceVetoRef* ref,Double_t c,IceVetoScratch& w) const
+{
+// Print the diagnostic time residuals of the veto hit stored at position "jhit"
+// by FlattenHits() with respect to the reference quantities "ref" of the event.
+// The light speed "c" has to be provided in m/ns.
+//
+// Note : This memberfunction is only invoked from the veto hit loops when this
+//        class was compiled with the preprocessor flag ICEVETO_DIAGNOSTICS
+//        and a verbosity level of at least 2 was selected via SetVerbose().
+
+ if (!ref || jhit<0 || jhit>=w.fNhits) return;
+
+ NcDevice* omx=w.fFired[w.fHdom[jhit]];
+ if (!omx) return;
+
+ Double_t rx[3]={w.fHx[jhit],w.fHy[jhit],w.fHz[jhit]};
+ Double_t t0=ref->fT0;
+ Double_t tstart=ref->fTstart;
+ Double_t tx=w.fHle[jhit];
+ Double_t dt0=tx-t0;
+ Double_t dtstart=tx-tstart;
+ Double_t dist0=0;
+ Double_t diststart=0;
+ Double_t dx=0;
+ for (Int_t i=0; i<3; i++)
+ {
+  dx=rx[i]-ref->fX0[i];
+  dist0+=dx*dx;
+  dx=rx[i]-ref->fXstart[i];
+  diststart+=dx*dx;
+ }
+ dist0=sqrt(dist0);
+ diststart=sqrt(diststart);
+ Double_t dz0=rx[2]-ref->fX0[2];
+ Double_t dzstart=rx[2]-ref->fXstart[2];
+ Double_t tres0=dt0-(dist0/c);
+ Double_t trestart=dtstart-(diststart/c);
+ Double_t tresz0=dt0-(dz0/c);
+ Double_t treszstart=dt0-(dzstart/c);
+
+ cout << " *IceVeto* Veto hit of DOM " << Int_t(omx->GetUniqueID()) << endl;
+ cout << " t0:" << t0 << " tstart:" << tstart << " tx:" << tx << " tx-t0:" << dt0 << " tx-tstart:" << dtstart << endl;
+ cout << " dist0:" << dist0 << " (dist0/c):" << (dist0/c) << " tres0:" << tres0 << endl;
+ cout << " diststart:" << diststart << " (diststart/c):" << (diststart/c) << " trestart:" << trestart << endl;
+ cout << " dz0:" << dz0 << " (dz0/c):" << (dz0/c) << " tresz0:" << tresz0 << endl;
+ cout << " dzstart:" << dzstart << " (dzstart/c):" << (dzstart/c) << " treszstart:" << treszstart << endl;
+}
+///////////////////////////////////////////////////////////////////////////
+Long64_t IceVeto::ProcessMT(TChain* data,Int_t nthreads,Long64_t* naccept,std::vector<Float_t>* levels)
+{
+// Multi-threaded veto evaluation of all the events contained in the TChain "data".
+// The events are read from the branch "IceEvent" and the entries are distributed
+// over the various threads by means of ROOT's TTreeProcessorMT.
+// Each thread uses its own work space (see GetScratch), and the veto systems are evaluated
+// via the thread safe Evaluate() memberfunction.
+// The tasks use the work spaces of this processing (see CreateScratch), of which
+// there are at most as many as simultaneously running tasks, and which are
+// released at the end of the processing.
+// Since the events are not stored again, no output devices are created.
+// Also the threshold scan (see AddScanPoint) is not performed, and no entries are
+// filled in the output tree of CreateResultTree().
+// The veto results are provided via the number of evaluated and accepted events,
+// and optionally via the overall veto level of each entry of "data".
+//
+// The TChain "data" itself is only used to provide the files to TTreeProcessorMT,
+// so the branch addresses of "data" are not modified.
+// In case ROOT's implicit multi-threading is not enabled at invokation, it is enabled for the
+// duration of the processing with "nthreads" threads, and disabled again afterwards.
+// In case it is already enabled with another number of threads than "nthreads" (>0), the thread pool
+// is re-created with "nthreads" threads for the processing, after which the original
+// thread pool size is restored. For nthreads=0 an existing thread pool is used as it is.
+//
+// Input arguments :
+// -----------------
+// data     : The TChain with the IceEvent data
+// nthreads : The number of threads to be used (0=all cores)
+// naccept  : Optional pointer to provide the number of accepted (i.e. not vetoed) events
+// levels   : Optional array to provide the overall veto level of each entry of "data"
+//            (a value of -1 indicates that the entry was not evaluated)
+//
+// The return argument is the number of evaluated events.
+//
+// Example :
+// ---------
+// IceVeto* veto=new IceVeto();
+// veto->ActivateVetoSystem("HESE86");
+// Long64_t naccept=0;
+// std::vector<Float_t> levels;
+// Long64_t nevt=veto->ProcessMT(data,8,&naccept,&levels);
+//
+// Notes :
+// -------
+// 1) The entry number of an event is obtained from the file it was read from and the entry
+//    in that file. So, in case the same file was added several times to "data", the
+//    veto levels are only provided for the entries of its first occurrence.
+// 2) This facility requires ROOT version 6.14 or higher.
+
+ if (naccept) *naccept=0;
+ if (levels) levels->clear();
+
+ if (!data) return 0;
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+ // Make sure that the compiled veto systems are up to date
+ CheckMasks();
+
+ // The entry offsets of the files of "data" to provide the veto level of each entry
+ Long64_t nentries=data->GetEntries();
+ std::vector<TString> fnames;
+ std::vector<Long64_t> offsets;
+ if (levels)
+ {
+  levels->assign(nentries,-1);
+  TObjArray* files=data->GetListOfFiles();
+  Long64_t* toffset=data->GetTreeOffset();
+  for (Int_t i=0; files && toffset && i<files->GetEntries(); i++)
+  {
+   if (!files->At(i)) continue;
+   fnames.push_back(files->At(i)->GetTitle());
+   offsets.push_back(toffset[i]);
+  }
+ }
+
+ // Enable the implicit multi-threading with the requested number of threads
+ // and record the state of the caller to restore it afterwards
+ Bool_t imt=ROOT::IsImplicitMTEnabled();
+ UInt_t npool=0;
+ if (imt)
+ {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,22,0)
+  npool=ROOT::GetThreadPoolSize();
+#else
+  npool=ROOT::GetImplicitMTPoolSize();
+#endif
+ }
+ Int_t resized=0;
+ if (imt && nthreads>0 && UInt_t(nthreads)!=npool)
+ {
+  ROOT::DisableImplicitMT();
+  ROOT::EnableImplicitMT(nthreads);
+  resized=1;
+ }
+ if (!imt) ROOT::EnableImplicitMT(nthreads);
+
+ std::atomic<Long64_t> nevt(0);
+ std::atomic<Long64_t> nacc(0);
+
+ // The work spaces of this processing, which are handed out to the tasks
+ // and are released after the processing
+ std::vector<IceVetoScratch*> spare;
+ std::vector<IceVetoScratch*> all;
+ std::mutex mspare;
+
+ ROOT::TTreeProcessorMT proc(*data);
+ proc.Process([&](TTreeReader& reader)
+ {
+  IceVetoScratch* scratch=0;
+  {
+   std::lock_guard<std::mutex> lock(mspare);
+   if (spare.size())
+   {
+    scratch=spare.back();
+    spare.pop_back();
+   }
+   else
+   {
+    scratch=CreateScratch();
+    all.push_back(scratch);
+   }
+  }
+
+  TTreeReaderValue<IceEvent> evt(reader,"IceEvent");
+  IceVetoResult res;
+  TTree* tree=0;
+  TTree* curtree=0;
+  TFile* file=0;
+  Long64_t offset=-1;
+  Long64_t ient=0;
+  Float_t level=0;
+  while (reader.Next())
+  {
+   level=-1;
+   if (Evaluate(evt.Get(),res,scratch))
+   {
+    nevt++;
+    level=res.fVetoLevel;
+    if (level<0.5) nacc++;
+   }
+
+   if (!levels) continue;
+
+   // Locate the entry in "data" via the file of the current tree.
+   // The entries of different tasks are different, so no locking is needed.
+   tree=reader.GetTree();
+   if (tree) tree=tree->GetTree();
+   if (!tree) continue;
+   if (tree!=curtree)
+   {
+    curtree=tree;
+    offset=-1;
+    file=curtree->GetCurrentFile();
+    for (Int_t i=0; file && i<Int_t(fnames.size()); i++)
+    {
+     if (fnames[i]!=file->GetName()) continue;
+     offset=offsets[i];
+     break;
+    }
+   }
+   if (offset<0) continue;
+   ient=offset+curtree->GetReadEntry();
+   if (ient>=0 && ient<nentries) (*levels)[ient]=level;
+  }
+
+  std::lock_guard<std::mutex> lock(mspare);
+  spare.push_back(scratch);
+ });
+
+ for (Int_t i=0; i<Int_t(all.size()); i++)
+ {
+  ReleaseScratch(all[i]);
+ }
+
+ // Restore the implicit multi-threading state of the caller
+ if (!imt) ROOT::DisableImplicitMT();
+ if (resized)
+ {
+  ROOT::DisableImplicitMT();
+  ROOT::EnableImplicitMT(npool);
+ }
+
+ if (naccept) *naccept=nacc;
+ return nevt;
+#else
+ cout << " *IceVeto::ProcessMT* Multi-threaded processing requires ROOT version 6.14 or higher." << endl;
+ cout << " Number of requested threads : " << nthreads << endl;
+ return 0;
+#endif
+}
+///////////////////////////////////////////////////////////////////////////
+Long64_t IceVeto::ProcessBatch(TChain* data,Long64_t first,Long64_t nevt,std::vector<Float_t>* levels,Long64_t* naccept)
+{
+// Veto evaluation of the "nevt" consecutive entries of the TChain "data", starting at entry "first".
+// The events are read from the branch "IceEvent" and evaluated one after the other
+// via the Evaluate() memberfunction, using the internal work space of this IceVeto object.
+// In this way the per event task dispatching and global task list lookup of the NcJob
+// processing are avoided, and the compiled veto systems and work space are re-used
+// for all the events of the batch.
+// Since the events are not stored again, no output devices are created.
+//
+// Input arguments :
+// -----------------
+// data    : The TChain with the IceEvent data
+// first   : The first entry to be processed
+// nevt    : The number of entries to be processed (<0 means all entries starting at "first")
+// levels  : Optional array to provide the overall veto level of each processed entry
+//           (a value of -1 indicates that the entry was not evaluated)
+// naccept : Optional pointer to provide the number of accepted (i.e. not vetoed) events
+//
+// The return argument is the number of evaluated events.
+//
+// Example :
+// ---------
+// IceVeto* veto=new IceVeto();
+// veto->ActivateVetoSystem("HESE86");
+// std::vector<Float_t> levels;
+// Long64_t nevt=veto->ProcessBatch(data,0,10000,&levels);
+//
+// Note : The entries are read into an event object owned by this memberfunction.
+//        The address of the "IceEvent" branch of "data" as set by the caller (if any)
+//        is restored after the processing, and the other branch addresses are not modified.
+//        When an output tree was created via CreateResultTree(), an entry
+//        is filled for each processed entry of "data".
+
+ if (naccept) *naccept=0;
+ if (levels) levels->clear();
+
+ if (!data || first<0) return 0;
+
+ Long64_t nentries=data->GetEntries();
+ Long64_t last=nentries;
+ if (nevt>=0 && first+nevt<nentries) last=first+nevt;
+ if (first>=last) return 0;
+
+ // Make sure that the compiled veto systems are up to date
+ CheckMasks();
+
+ if (levels) levels->reserve(last-first);
+
+ // Make sure that the work space is available
+ GetExecScratch();
+
+ // Read the entries into a private event object, and remember the branch address of the caller
+ TBranch** bptr=0;
+ void* address=IceVetoGetAddress(data,&bptr);
+ IceEvent* evt=new IceEvent();
+ data->SetBranchAddress("IceEvent",&evt);
+
+ Long64_t neval=0;
+ Long64_t nacc=0;
+ Float_t level=0;
+ Int_t eval=0;
+ for (Long64_t ient=first; ient<last; ient++)
+ {
+  level=-1;
+  eval=0;
+  if (data->GetEntry(ient)>0) eval=Evaluate(evt,fResult,fScratch);
+  if (eval)
+  {
+   if (fScan.size()) ScanEvent(evt,*fScratch);
+   neval++;
+   level=fResult.fVetoLevel;
+   if (level<0.5) nacc++;
+  }
+  if (levels) levels->push_back(level);
+  if (fTree) FillResultTree(evt,eval,fResult);
+ }
+
+ IceVetoSetAddress(data,address,bptr);
+ delete evt;
+
+ if (naccept) *naccept=nacc;
+ return neval;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::ProcessBatch(IceEvent** evts,Int_t nevt,std::vector<Float_t>* levels,Int_t store)
+{
+// Veto evaluation of the array "evts" of "nevt" events.
+// The events are evaluated one after the other via the Evaluate() memberfunction,
+// using the internal work space of this IceVeto object, which avoids the
+// per event task dispatching of the NcJob processing.
+//
+// Input arguments :
+// -----------------
+// evts   : The array of pointers to the events
+// nevt   : The number of events in the array
+// levels : Optional array to provide the overall veto level of each event
+//          (a value of -1 indicates that the event was not evaluated)
+// store  : Flag to store (1) the output devices in the events, as done by Exec(), or not (0)
+//
+// The return argument is the number of evaluated events.
+//
+// Note : When an output tree was created via CreateResultTree(), an entry
+//        is filled for each event of the array.
+
+ if (levels) levels->clear();
+
+ if (!evts || nevt<=0) return 0;
+
+ // Make sure that the compiled veto systems are up to date
+ CheckMasks();
+
+ if (levels) levels->reserve(nevt);
+
+ // Make sure that the work space is available
+ GetExecScratch();
+
+ Int_t neval=0;
+ Float_t level=0;
+ Int_t eval=0;
+ for (Int_t i=0; i<nevt; i++)
+ {
+  level=-1;
+  eval=Evaluate(evts[i],fResult,fScratch);
+  if (eval)
+  {
+   if (fScan.size()) ScanEvent(evts[i],*fScratch);
+   neval++;
+   level=fResult.fVetoLevel;
+   if (store) StoreResult(evts[i],fResult,fScratch);
+  }
+  else if (store && fResult.fGated)
+  {
+   StoreGate(evts[i],fResult);
+  }
+  if (levels) levels->push_back(level);
+  if (fTree) FillResultTree(evts[i],eval,fResult);
+ }
+
+ return neval;
+}
+///////////////////////////////////////////////////////////////////////////
+Long64_t IceVeto::ProcessPipeline(TChain* data,Int_t nworkers,Int_t depth,TTree* output,Long64_t* naccept)
+{
+// Pipelined veto evaluation of all the events contained in the TChain "data",
+// in which the reading of the events overlaps with the veto evaluation.
+// A reader thread reads (and decompresses) the events from the branch "IceEvent"
+// into a bounded queue, from which the events are taken by the worker threads
+// that perform the veto evaluation via the thread safe Evaluate() memberfunction.
+// Each worker thread uses its own work space (see CreateScratch), which is
+// released when the worker thread has finished.
+// In this way the processing time is determined by the slowest of the stages,
+// instead of by the sum of the reading and veto evaluation times.
+//
+// Optionally, the accepted (i.e. not vetoed) events are written by a separate
+// writer thread into the branch "IceEvent" of the tree "output", which is created
+// in case it doesn't exist yet. These events contain the output devices of the
+// veto systems, as provided by Exec().
+// Only the events that were evaluated and accepted are written. So, events that were
+// not evaluated, like events without hits or events that failed the pre-veto gate
+// (see SetPreGate), are not written into "output".
+// Note that the events are not necessarily written in the order of the input data
+// in case several worker threads are used.
+//
+// The IceEvent objects are taken from a fixed pool, which limits the memory usage
+// to about 2*depth+nworkers events, independent of the number of events of "data".
+// A pooled event is reset (see NcEvent::Reset) before the next entry is read into it,
+// so that no output devices of a previous event remain in the event.
+// The branch address of "data" and "output" is set to the pooled event before each
+// reading and writing of an entry, respectively.
+// The TChain "data" and the tree "output" are only accessed by the reader and
+// writer thread, respectively.
+// Since several threads are processing events simultaneously, no entries are
+// filled in the output tree of CreateResultTree() and the threshold scan
+// (see AddScanPoint) is not performed.
+//
+// Input arguments :
+// -----------------
+// data     : The TChain with the IceEvent data
+// nworkers : The number of worker threads (0=all cores except the one of the reader)
+// depth    : The maximum number of events that are queued between the stages
+// output   : Optional tree to store the accepted events
+// naccept  : Optional pointer to provide the number of accepted (i.e. not vetoed) events
+//
+// The return argument is the number of evaluated events.
+//
+// Example :
+// ---------
+// IceVeto* veto=new IceVeto();
+// veto->ActivateVetoSystem("HESE86");
+// TFile* ofile=new TFile("accepted.icepack","RECREATE");
+// TTree* otree=new TTree("T","Accepted events");
+// Long64_t naccept=0;
+// Long64_t nevt=veto->ProcessPipeline(data,4,32,otree,&naccept);
+// otree->Write();
+//
+// Note : The address of the "IceEvent" branch of "data" and "output" as set by the caller (if any)
+//        is restored after the processing, and the other branch addresses are not modified.
+
+ if (naccept) *naccept=0;
+
+ if (!data) return 0;
+
+ if (nworkers<=0)
+ {
+  nworkers=Int_t(std::thread::hardware_concurrency())-1;
+  if (nworkers<1) nworkers=1;
+ }
+ if (depth<1) depth=1;
+
+ // Make sure that the compiled veto systems are up to date
+ CheckMasks();
+
+ // Enable the protection of the ROOT internals for the concurrent (de)serialization.
+ // This is needed only once for the whole application.
+ static std::once_flag safety;
+ std::call_once(safety,[](){ ROOT::EnableThreadSafety(); });
+
+ // The pool of event objects that are passed between the stages
+ Int_t npool=2*depth+nworkers;
+ IceVetoQueue<IceEvent*> pool(npool);
+ for (Int_t i=0; i<npool; i++)
+ {
+  pool.Push(new IceEvent());
+ }
+
+ IceVetoQueue<IceEvent*> input(depth);
+ IceVetoQueue<IceEvent*> accepted(depth);
+
+ std::atomic<Long64_t> nevt(0);
+ std::atomic<Long64_t> nacc(0);
+
+ // The reader stage
+ std::thread reader([&]()
+ {
+  TBranch** bptr=0;
+  void* address=IceVetoGetAddress(data,&bptr);
+
+  // Each entry is read into a pooled event, so no event objects are created by ROOT
+  IceEvent* evt=0;
+  Long64_t nentries=data->GetEntries();
+  for (Long64_t ient=0; ient<nentries; ient++)
+  {
+   if (!evt) evt=pool.Pop();
+   if (!evt) break;
+   evt->Reset();
+   data->SetBranchAddress("IceEvent",&evt);
+   if (data->GetEntry(ient)<=0) continue;
+   input.Push(evt);
+   evt=0;
+  }
+  if (evt) pool.Push(evt);
+
+  IceVetoSetAddress(data,address,bptr);
+
+  // Indicate the end of the data to each worker
+  for (Int_t i=0; i<nworkers; i++)
+  {
+   input.Push(0);
+  }
+ });
+
+ // The veto evaluation stage
+ std::vector<std::thread> workers;
+ for (Int_t iw=0; iw<nworkers; iw++)
+ {
+  workers.push_back(std::thread([&]()
+  {
+   IceVetoScratch* scratch=CreateScratch();
+   IceVetoResult res;
+   IceEvent* evt=0;
+   while ((evt=input.Pop()))
+   {
+    if (Evaluate(evt,res,scratch))
+    {
+     nevt++;
+     if (res.fVetoLevel<0.5)
+     {
+      nacc++;
+      if (output)
+      {
+       StoreResult(evt,res,scratch);
+       accepted.Push(evt);
+       continue;
+      }
+     }
+    }
+    pool.Push(evt);
+   }
+   ReleaseScratch(scratch);
+   if (output) accepted.Push(0);
+  }));
+ }
+
+ // The optional writer stage
+ std::thread writer;
+ if (output)
+ {
+  writer=std::thread([&]()
+  {
+   TBranch* branch=output->GetBranch("IceEvent");
+   char* address=0;
+   if (branch) address=branch->GetAddress();
+
+   // The branch is created at the first accepted event, so no event object is created by ROOT
+   IceEvent* evt=0;
+   Int_t nend=0;
+   while (nend<nworkers)
+   {
+    evt=accepted.Pop();
+    if (!evt)
+    {
+     nend++;
+     continue;
+    }
+    if (branch)
+    {
+     output->SetBranchAddress("IceEvent",&evt);
+    }
+    else
+    {
+     branch=output->Branch("IceEvent",&evt,32000,99);
+    }
+    output->Fill();
+    pool.Push(evt);
+   }
+
+   // Restore the branch address of the caller
+   if (address)
+   {
+    output->SetBranchAddress("IceEvent",address);
+   }
+   else if (branch)
+   {
+    output->ResetBranchAddress(branch);
+   }
+  });
+ }
+
+ reader.join();
+ for (Int_t iw=0; iw<nworkers; iw++)
+ {
+  workers[iw].join();
+ }
+ if (output) writer.join();
+
+ // Delete the pool of event objects
+ for (Int_t i=0; i<npool; i++)
+ {
+  delete pool.Pop();
+ }
+
+ if (naccept) *naccept=nacc;
+ return nevt;
+}
+///////////////////////////////////////////////////////////////////////////
+TTree* IceVeto::CreateResultTree(TString name,TString title)
+{
+// Create a flat output tree with one entry per processed event, which contains
+// the run number ("Run"), event number ("Event") and overall veto level ("VetoLevel"),
+// together with the quantities "NdomVeto", "NhitVeto", "QtotVeto" and "VetoLevel"
+// of each veto system, stored in branches named as "HESE86_NdomVeto" etc.
+// All branches consist of plain Int_t or Float_t values.
+//
+// The output tree is filled by Exec() and ProcessBatch() for each event they process,
+// also for events which were not evaluated (e.g. rejected by an NcEventSelector),
+// in which case the veto levels are set to -1.
+// This implies that the output tree can be used as a friend of the tree
+// which contains the events, to investigate the veto observables without
+// the need to read the full event structures.
+// Note that ProcessMT() does not fill the output tree, since the processing
+// order of the events is not guaranteed.
+//
+// The output tree is created in the current ROOT directory, so the output
+// file should be opened before invokation of this memberfunction, and the tree
+// should be written to the file (e.g. via TFile::Write()) after the processing.
+// The branches are defined for the veto systems that are present at invokation,
+// so all veto systems should be defined or activated beforehand.
+// Re-invokation of this memberfunction will create a new output tree,
+// and the previous one will not be filled anymore.
+//
+// Example :
+// ---------
+// TFile* ofile=new TFile("veto.root","RECREATE");
+// IceVeto* veto=new IceVeto();
+// veto->ActivateVetoSystem("HESE86");
+// veto->CreateResultTree();
+// veto->ProcessBatch(data,0,-1);
+// ofile->Write();
+//
+// The return argument is the pointer to the created output tree.
+
+ Int_t nvetos=0;
+ if (fVetos) nvetos=fVetos->GetEntries();
+
+ fTreeNdom.assign(nvetos,0);
+ fTreeNhit.assign(nvetos,0);
+ fTreeQtot.assign(nvetos,0);
+ fTreeSysLevel.assign(nvetos,0);
+
+ fTree=new TTree(name.Data(),title.Data());
+ fTree->Branch("Run",&fTreeRun,"Run/I");
+ fTree->Branch("Event",&fTreeEvent,"Event/I");
+ fTree->Branch("VetoLevel",&fTreeLevel,"VetoLevel/F");
+
+ TObject* obj=0;
+ TString sname;
+ TString bname;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  obj=fVetos->At(isys);
+  if (!obj) continue;
+
+  sname=obj->GetName();
+
+  bname=sname+"_NdomVeto";
+  fTree->Branch(bname.Data(),&fTreeNdom[isys],bname+"/I");
+  bname=sname+"_NhitVeto";
+  fTree->Branch(bname.Data(),&fTreeNhit[isys],bname+"/I");
+  bname=sname+"_QtotVeto";
+  fTree->Branch(bname.Data(),&fTreeQtot[isys],bname+"/F");
+  bname=sname+"_VetoLevel";
+  fTree->Branch(bname.Data(),&fTreeSysLevel[isys],bname+"/F");
+ }
+
+ return fTree;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::FillResultTree(IceEvent* evt,Int_t eval,IceVetoResult& res)
+{
+// Fill the output tree entry for the event "evt" with the veto result "res".
+// The flag "eval" indicates whether the event was evaluated (1) or not (0).
+
+ if (!fTree) return;
+
+ fTreeRun=0;
+ fTreeEvent=0;
+ if (evt)
+ {
+  fTreeRun=evt->GetRunNumber();
+  fTreeEvent=evt->GetEventNumber();
+ }
+
+ fTreeLevel=-1;
+ if (eval) fTreeLevel=res.fVetoLevel;
+
+ IceVetoSysResult* sres=0;
+ for (Int_t isys=0; isys<Int_t(fTreeNdom.size()); isys++)
+ {
+  fTreeNdom[isys]=0;
+  fTreeNhit[isys]=0;
+  fTreeQtot[isys]=0;
+  fTreeSysLevel[isys]=-1;
+
+  if (!eval || isys>=Int_t(res.fSys.size())) continue;
+
+  sres=&res.fSys[isys];
+  fTreeNdom[isys]=sres->fNdom;
+  fTreeNhit[isys]=sres->fNhit;
+  fTreeQtot[isys]=sres->fQtot;
+  fTreeSysLevel[isys]=sres->fLevel;
+ }
+
+ fTree->Fill();
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::SetMinimalRead(TChain* data,Long64_t cachesize)
+{
+// Restrict the reading of the TChain "data" to the information which is needed
+// for the veto evaluation, to reduce the I/O for veto-only processing passes.
+//
+// The veto evaluation only needs the "IceEvent" branch, from which only the
+// run and event numbers, the devices (IceGOM positions and their LE, ADC and SLC
+// hit data, and a possible NcEventSelector device) and the hit references are used.
+// So, all other branches of "data" are disabled.
+// In case the "IceEvent" branch was written in split mode, also its sub-branches
+// containing the tracks, jets, vertices and display objects are disabled.
+// For an unsplit "IceEvent" branch the full event is read, since the
+// devices and their hits are stored as a single object in that case.
+//
+// In addition, a TTreeCache of "cachesize" bytes is activated for the
+// remaining branches, which reduces the number of (remote) read operations.
+// A value cachesize<=0 will leave the cache settings unchanged.
+//
+// Notes :
+// -------
+// 1) Since the disabled data are not read, the events obtained via GetEntry()
+//    should only be used for the veto evaluation and not be written out again.
+// 2) This memberfunction should be invoked before SetBranchAddress().
+//
+// Example :
+// ---------
+// TChain* data=new TChain("T");
+// data->Add("*.icepack");
+// IceVeto::SetMinimalRead(data);
+// IceEvent* evt=0;
+// data->SetBranchAddress("IceEvent",&evt);
+//
+// The return argument is the number of disabled sub-branches of the "IceEvent" branch.
+
+ if (!data) return 0;
+
+ TBranch* evtbranch=data->GetBranch("IceEvent");
+ if (!evtbranch)
+ {
+  cout << " *IceVeto::SetMinimalRead* No IceEvent branch present." << endl;
+  return 0;
+ }
+
+ data->SetBranchStatus("*",0);
+ data->SetBranchStatus("IceEvent",1);
+ data->SetBranchStatus("IceEvent*",1);
+
+ // The (trailing) names of the sub-branches which are not needed for the vetoing
+ const Int_t nskip=6;
+ const char* skip[nskip]={"fTracks","fJets","fVertices","fConnects","fJetTracks","fDisplay"};
+
+ Int_t ndisabled=0;
+ TObjArray* branches=evtbranch->GetListOfBranches();
+ TBranch* bx=0;
+ TString bname;
+ TString member;
+ Int_t idx=0;
+ if (branches)
+ {
+  for (Int_t i=0; i<branches->GetEntries(); i++)
+  {
+   bx=(TBranch*)branches->At(i);
+   if (!bx) continue;
+
+   bname=bx->GetName();
+   member=bname;
+   idx=bname.Last('.');
+   if (idx>=0) member=bname(idx+1,bname.Length()-idx-1);
+
+   for (Int_t j=0; j<nskip; j++)
+   {
+    if (member!=skip[j] && !member.BeginsWith(TString(skip[j])+"[")) continue;
+    bname+="*";
+    data->SetBranchStatus(bname.Data(),0);
+    ndisabled++;
+    break;
+   }
+  }
+ }
+
+ if (cachesize>0)
+ {
+  data->SetCacheSize(cachesize);
+  data->AddBranchToCache("IceEvent*",kTRUE);
+ }
+
+ return ndisabled;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::AddScanPoint(TString name,Float_t qtot,Float_t amp,Int_t ndom,Int_t nhit,Float_t tresmin,Float_t tresmax)
+{
+// Add a veto configuration for the (already defined) veto system "name" to the threshold scan.
+// The parameters have the same meaning as in DefineVetoSystem(), whereas the
+// SLC selection and the veto DOMs of the veto system itself are used.
+//
+// For each event processed via Exec() or ProcessBatch(), the candidate veto hits
+// of each veto system with scan configurations are collected once, i.e. all the
+// hits of its veto DOMs which satisfy the SLC selection, keeping only the
+// amplitude, time residual and DOM of each hit.
+// All the scan configurations are subsequently evaluated from these candidate veto hits,
+// such that a complete grid of thresholds is obtained from a single pass over the data.
+// The results are provided as pass fractions (i.e. the fraction of the evaluated events
+// that are not vetoed by a configuration) via ListScan() and GetScanFraction().
+// The scan doesn't affect the veto results of the events themselves.
+// Events for which the reference quantities of a veto system can not be obtained
+// are not evaluated for the scan configurations of that veto system, and as such
+// don't enter their pass fractions.
+//
+// Notes :
+// -------
+// 1) If tresmin>tresmax the time residual is not taken into account.
+// 2) The threshold scan is only performed by Exec() and the ProcessBatch() memberfunctions,
+//    since it uses the internal work space of this IceVeto object. The multi-threaded
+//    processing via ProcessMT() and ProcessPipeline() doesn't perform the threshold scan.
+//
+// The return argument is the index of the scan configuration, or -1 if the
+// veto system was not found.
+
+ Int_t isys=GetVetoIndex(name);
+ if (isys<0)
+ {
+  cout << " *IceVeto::AddScanPoint* No veto system found with name : " << name.Data() << endl;
+  return -1;
+ }
+
+ if (ndom<=0) ndom=1;
+ if (nhit<=0) nhit=1;
+
+ IceVetoScanPoint point;
+ point.fSys=isys;
+ point.fQtotMin=qtot;
+ point.fAmpMin=amp;
+ point.fNdomMin=ndom;
+ point.fNhitMin=nhit;
+ point.fTresMin=tresmin;
+ point.fTresMax=tresmax;
+ point.fNpass=0;
+ point.fNeval=0;
+
+ fScan.push_back(point);
+
+ return Int_t(fScan.size())-1;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::AddScanGrid(TString name,const std::vector<Float_t>& qtot,const std::vector<Float_t>& amp,const std::vector<Int_t>& ndom,
+                           const std::vector<Int_t>& nhit,const std::vector<Float_t>& tresmin,const std::vector<Float_t>& tresmax)
+{
+// Add a grid of veto configurations for the veto system "name" to the threshold scan.
+// All the combinations of the provided "qtot", "amp", "ndom" and "nhit" values and
+// time residual windows [tresmin[i],tresmax[i]] are added via AddScanPoint().
+// So, "tresmin" and "tresmax" should have the same number of entries.
+//
+// The return argument is the number of added scan configurations.
+
+ if (GetVetoIndex(name)<0)
+ {
+  cout << " *IceVeto::AddScanGrid* No veto system found with name : " << name.Data() << endl;
+  return 0;
+ }
+
+ if (tresmin.size()!=tresmax.size())
+ {
+  cout << " *IceVeto::AddScanGrid* Inconsistent number of time residual window boundaries." << endl;
+  return 0;
+ }
+
+ Int_t nadd=0;
+ for (Int_t iq=0; iq<Int_t(qtot.size()); iq++)
+ {
+  for (Int_t ia=0; ia<Int_t(amp.size()); ia++)
+  {
+   for (Int_t id=0; id<Int_t(ndom.size()); id++)
+   {
+    for (Int_t ih=0; ih<Int_t(nhit.size()); ih++)
+    {
+     for (Int_t it=0; it<Int_t(tresmin.size()); it++)
+     {
+      if (AddScanPoint(name,qtot[iq],amp[ia],ndom[id],nhit[ih],tresmin[it],tresmax[it])>=0) nadd++;
+     }
+    }
+   }
+  }
+ }
+
+ return nadd;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ResetScan(Int_t mode)
+{
+// Reset the counters of the threshold scan (mode=0) or remove all the
+// scan configurations (mode=1).
+// The default is mode=0.
 
- // Only process accepted events
- NcDevice* seldev=evt->GetDevice("NcEventSelector");
- if (seldev)
+ fScanEvents=0;
+
+ if (mode)
  {
-  if (seldev->GetSignal("Select") < 0.1) return;
+  fScan.clear();
+  return;
  }
 
- // The number of all OMs with a signal in the event
- Int_t nmods=evt->GetNdevices("IceGOM");
- if (!nmods) return;
+ for (Int_t i=0; i<Int_t(fScan.size()); i++)
+ {
+  fScan[i].fNpass=0;
+  fScan[i].fNeval=0;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ListScan() const
+{
+// Print the pass fraction table of the threshold scan.
 
- // Get the light speed in m/ns
- NcAstrolab lab;
- Double_t c=lab.GetPhysicalParameter("SpeedC")*1.e-9;
+ cout << " *IceVeto::ListScan* Threshold scan with " << fScan.size() << " configurations for " << fScanEvents << " events." << endl;
 
+ const IceVetoScanPoint* point=0;
+ TObject* obj=0;
+ for (Int_t i=0; i<Int_t(fScan.size()); i++)
+ {
+  point=&fScan[i];
+  obj=0;
+  if (fVetos) obj=fVetos->At(point->fSys);
+  cout << " " << i << " " << (obj ? obj->GetName() : "?") << " QtotVetoMin:" << point->fQtotMin << " AmpVetoMin:" << point->fAmpMin
+       << " NdomVetoMin:" << point->fNdomMin << " NhitVetoMin:" << point->fNhitMin
+       << " TresVetoMin:" << point->fTresMin << " TresVetoMax:" << point->fTresMax
+       << " Neval:" << point->fNeval << " Npass:" << point->fNpass << " Fraction:" << GetScanFraction(i) << endl;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVeto::GetNscanPoints() const
+{
+// Provide the number of threshold scan configurations.
 
- Float_t vetolevel=0; // Overall veto level
+ return Int_t(fScan.size());
+}
+///////////////////////////////////////////////////////////////////////////
+Long64_t IceVeto::GetScanEvents() const
+{
+// Provide the number of events used in the threshold scan.
+// The number of events that were actually evaluated for a certain scan configuration
+// is listed by ListScan().
 
- // Loop over all the defined veto systems
- NcVeto* dveto=0;
- Float_t lveto=0; // Veto level for a specific system
- Float_t qtotmin=0;
- Float_t ampmin=0;
- Int_t ndommin=0;
- Int_t nhitmin=0;
- Int_t slc=0;
- Float_t tresmin=0;
- Float_t tresmax=0;
- NcSignal* vdom=0;
- NcDevice* omx=0;
- NcPosition rx;
- Double_t tx;
- Double_t dist0=0;
- NcSignal* sx=0;
- Double_t thit=0;
+ return fScanEvents;
+}
+///////////////////////////////////////////////////////////////////////////
+Double_t IceVeto::GetScanFraction(Int_t ipoint) const
+{
+// Provide the fraction of the evaluated events that are not vetoed by the threshold scan
+// configuration with index "ipoint".
+// Events for which the reference quantities of the veto system could not be obtained
+// are not evaluated, and as such are not taken into account.
+//
+// In case of inconsistency a value -1 will be returned.
+
+ if (ipoint<0 || ipoint>=Int_t(fScan.size()) || fScan[ipoint].fNeval<=0) return -1;
+
+ return Double_t(fScan[ipoint].fNpass)/Double_t(fScan[ipoint].fNeval);
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVeto::ScanEvent(IceEvent* evt,IceVetoScratch& w)
+{
+// Evaluate all the threshold scan configurations for the current event,
+// of which the hits were stored in the work space "w" by Evaluate().
+// The candidate veto hits of a veto system are collected only once, after which
+// each scan configuration is evaluated from these candidate veto hits.
+
+ if (!evt || !fVetos) return;
+
+ fScanEvents++;
+
+ Double_t c=fSpeedC;
+ Int_t nvetos=fVetos->GetEntries();
+ Int_t lastsys=-1;
+ const IceVetoConfig* cfg=0;
+ IceVetoRef* ref=0;
+ const IceVetoScanPoint* point=0;
+ Int_t isys=0;
+ Int_t index=0;
+ Double_t dx=0;
+ Double_t dy=0;
+ Double_t dz=0;
  Double_t tres0=0;
- Int_t domid=0;
  Float_t qtot=0;
- Float_t amp=0;
- Int_t ndom=0;
  Int_t nhit=0;
- Int_t vetohit=0; // Flag to indicate the encounter of a valid veto hit
- TString vetoname;
- NcVeto dum;
- dum.SetHitCopy(0);
- TString dumname;
- TObjArray hits;    // Temp. storage of hits to be analysed
- TObjArray ordered; // Temp. storage of ordered hits to be analysed
- Double_t totamp=0; // Total signal amplitude of the hits to be analysed
- NcPosition r0;     // Reference position (e.g. COG) of the event
- Double_t t0=0;     // Reference time (e.g. central hit time)
- Double_t thres=0;  // Signal threshold to determine the event start time
- Double_t twin=0;   // Time window size to determine the event start time
- Double_t tstart=0; // Start time of the event
- NcPosition rstart; // Position of the start signal of the event
- Double_t dt0=0;
- Double_t dtstart=0;
- Double_t diststart=0;
- Double_t trestart=0;
- Double_t dz0=0;
- Double_t dzstart=0;
- Double_t tresz0=0;
- Double_t treszstart=0;
- Int_t i1,i2; // Indices defining the search window in the time ordered hit array
- for (Int_t isys=0; isys<fVetos->GetEntries(); isys++)
+ Int_t ndom=0;
+ Int_t lastindex=-1;
+ Int_t window=0;
+ for (Int_t ipoint=0; ipoint<Int_t(fScan.size()); ipoint++)
  {
-  dveto=(NcVeto*)fVetos->At(isys);
-  if (!dveto) continue;
-
-  vetoname=dveto->GetName();
+  point=&fScan[ipoint];
+  isys=point->fSys;
+  if (isys<0 || isys>=nvetos || !fVetos->At(isys)) continue;
 
-  // Determine the InIce center of gravity, central hit time and event start time
-  if (vetoname=="HESE86")
+  // Collect the candidate veto hits of this veto system
+  if (isys!=lastsys)
   {
-   evt->GetHits("IceICDOM",&hits,"SLC",-2);
+   lastsys=isys;
+   w.fNcand=0;
+
+   // Without reference quantities the veto system is not evaluated for this event
+   cfg=&fConfigs[isys];
+   ref=GetReference(evt,cfg->fHitClass,-2,w);
+   if (!ref) continue;
+
+   if (w.fNhits>Int_t(w.fSamp.size()))
+   {
+    w.fSamp.resize(2*w.fNhits);
+    w.fStres.resize(2*w.fNhits);
+    w.fSdom.resize(2*w.fNhits);
+   }
+
+   for (Int_t jhit=0; jhit<w.fNhits; jhit++)
+   {
+    index=w.fHdom[jhit];
+    if (!IsVetoDOM(isys,index)) continue;
+    if (!cfg->fSLC && w.fHslc[jhit]) continue;
+
+    dx=w.fHx[jhit]-ref->fX0[0];
+    dy=w.fHy[jhit]-ref->fX0[1];
+    dz=w.fHz[jhit]-ref->fX0[2];
+    tres0=(w.fHle[jhit]-ref->fT0)-(sqrt(dx*dx+dy*dy+dz*dz)/c);
+
+    w.fSamp[w.fNcand]=w.fHadc[jhit];
+    w.fStres[w.fNcand]=tres0;
+    w.fSdom[w.fNcand]=index;
+    w.fNcand++;
+   }
   }
-  else
-  {
-///@@@   evt->GetHits("IceIDOM",&hits);
-   evt->GetHits("IceIDOM",&hits,"SLC",-2);
-  }
-  r0=evt->GetCOG(&hits,1,"ADC",8);
-  t0=evt->GetCVAL(&hits,"LE","ADC",8);
-  totamp=dum.SumSignals("ADC",8,&hits);
-
-  dum.SortHits("LE",1,&hits,8,1,&ordered); // Sort hits with increasing hit time
-
-  thres=0.05*totamp;
-  if (thres<3) thres=3;
-  twin=3000;
-  tstart=dum.SlideWindow(&ordered,thres,twin,"LE",8,"ADC",8,&i1,&i2);
-
-  // Get the position of the event start signal
-  rstart.SetZero();
-  if (i2>=0)
-  {
-   sx=(NcSignal*)ordered.At(i2);
-   if (sx) omx=sx->GetDevice();
-   if (omx) rstart=omx->GetPosition(); 
-  }
-
-  // The veto parameters of this veto system
-  qtotmin=dveto->GetSignal("QtotVetoMin");
-  ampmin=dveto->GetSignal("AmpVetoMin");
-  ndommin=dveto->GetSignal("NdomVetoMin");
-  nhitmin=dveto->GetSignal("NhitVetoMin");
-  slc=dveto->GetSignal("SLCVeto");
-  tresmin=dveto->GetSignal("TresVetoMin");
-  tresmax=dveto->GetSignal("TresVetoMax");
-
-  dum.Reset();
-  dum.SetUniqueID(dveto->GetUniqueID());
-  dumname=GetName();
-  dumname+="-";
-  dumname+=vetoname;
-  dum.SetNameTitle(dumname.Data(),dveto->GetTitle());
-
-  evt->AddDevice(dum);
-  NcVeto* params=(NcVeto*)evt->GetDevice(dumname);
-  if (!params) continue;
-
-  params->AddNamedSlot("SLCVeto");
-  params->AddNamedSlot("AmpVetoMin");
-  params->AddNamedSlot("NdomVetoMin");
-  params->AddNamedSlot("NhitVetoMin");
-  params->AddNamedSlot("QtotVetoMin");
-  params->AddNamedSlot("TresVetoMin");
-  params->AddNamedSlot("TresVetoMax");
-  params->AddNamedSlot("NdomVeto");
-  params->AddNamedSlot("NhitVeto");
-  params->AddNamedSlot("QtotVeto");
-  params->AddNamedSlot("VetoLevel");
-
-  lveto=0;
+
+  if (!ref) continue;
+
+  // Evaluate this scan configuration from the candidate veto hits
   qtot=0;
-  ndom=0;
   nhit=0;
+  ndom=0;
+  lastindex=-1;
+  window=(point->fTresMin<=point->fTresMax) ? 1 : 0;
+  for (Int_t jcand=0; jcand<w.fNcand; jcand++)
+  {
+   if (w.fSamp[jcand]<point->fAmpMin) continue;
+   if (window && (w.fStres[jcand]<point->fTresMin || w.fStres[jcand]>point->fTresMax)) continue;
 
-  // Loop over all the veto DOMs of this veto system
-  for (Int_t ivdom=1; ivdom<=dveto->GetNhits(); ivdom++)
+   if (w.fSdom[jcand]!=lastindex)
+   {
+    ndom++;
+    lastindex=w.fSdom[jcand];
+   }
+   nhit++;
+   qtot+=w.fSamp[jcand];
+  }
+
+  fScan[ipoint].fNeval++;
+
+  if (qtot>=point->fQtotMin && ndom>=point->fNdomMin && nhit>=point->fNhitMin) continue;
+
+  fScan[ipoint].fNpass++;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+IceVetoStream::IceVetoStream(IceVeto* veto) : TObject()
+{
+// Constructor for the incremental veto evaluation of a time ordered hit stream.
+//
+// This facility allows to obtain a veto decision for (realtime) hit streams without
+// the need of a fully built IceEvent structure, by providing the hits one at a time
+// or in small batches via AddHit() or AddHits().
+// The veto systems and their criteria are those of the IceVeto processor "veto",
+// as defined via IceVeto::DefineVetoSystem() and IceVeto::ActivateVetoSystem().
+//
+// For each veto system, running accumulators of the total veto hit amplitude,
+// the number of veto hits and the number of DOMs with a veto hit are kept.
+// In parallel the event start time is determined from the incoming InIce hits in the
+// same way as by NcDevice::SlideWindow(), i.e. the start time of the first time window
+// of size "twin" in which the accumulated amplitude reaches the signal threshold
+// (see SetStartWindow). Like in IceVeto, this signal threshold is 5% of the total
+// signal amplitude of the reference hits, with a minimum of "thres".
+//
+// A veto decision is emitted as soon as one of the veto systems meets its veto criteria,
+// since the accumulators can only increase. Otherwise, the decision is emitted when the
+// hit stream is closed, which happens at the first hit that arrives later than a time
+// "tclose" after the event start, or by invokation of Close().
+// After the decision, further hits are ignored until Reset() is invoked for a new hit stream.
+//
+// Notes :
+// -------
+// 1) The hits have to be provided in (approximately) increasing time order.
+// 2) Like in IceVeto, the time residual of a veto hit (for veto systems with TresVetoMin<=TresVetoMax)
+//    is determined with respect to the amplitude weighted central hit time and center of gravity
+//    of the (non-SLC) reference hits. Since these are only known for the complete hit stream,
+//    the veto DOM hits of these veto systems are kept, and are tested when the hit stream is closed.
+//    These time residuals require the DOM positions of all the InIce DOMs to be provided via AddHit().
+// 3) Since the total signal amplitude of the event is not known in advance, the signal threshold
+//    for the event start time is obtained from the total amplitude of the reference hits that were
+//    processed so far. So, the event start time (which only serves to close the hit stream)
+//    may be somewhat earlier than the one determined by IceVeto.
+// 4) All veto systems provide the same observables as IceVeto, provided that all the hits
+//    of the event are processed before the hit stream is closed.
+// 5) The veto systems of "veto" are taken at the invokation of Reset(), so after
+//    (re)defining veto systems Reset() should be invoked.
+//    The compiled parameters of the veto systems are however always obtained from the
+//    current state of "veto", so modified veto parameters are used for the subsequent hits,
+//    and veto systems that were removed in the meantime are skipped.
+// 6) The event start time is determined from the non-SLC hits of the InIce DOMs,
+//    which corresponds to the hit selection NcEvent::GetHits("IceIDOM",hits,"SLC",-2)
+//    that IceVeto uses for the reference quantities of the events.
+//    For veto systems with the reference hit class "IceICDOM" (i.e. "HESE86"), the central
+//    hit time and center of gravity are obtained from the InIce DOMs of the strings 1-78,
+//    whereas also the DeepCore DOMs of the hit stream contribute to the event start time.
+// 7) This facility only serves the processing of hit streams, so it has no persistent
+//    data members. The DOM positions are kept in a heap allocated table, so that
+//    IceVetoStream objects may also be created on the stack.
+//    The hits of the start time window are kept only as long as they are within the
+//    time window, so the memory use does not grow when no event start is found.
+//
+// Example :
+// ---------
+// IceVeto veto;
+// veto.ActivateVetoSystem("HESE86");
+// IceVetoStream stream(&veto);
+// while (...) // Loop over the incoming hits
+// {
+//  if (stream.AddHit(domid,le,adc,slc)>=0) break; // Veto decision available
+// }
+// Int_t level=stream.Close();
+//
+// The default values are thres=3, twin=3000 ns and tclose=3000 ns.
+
+ fVeto=0;
+ fThres=3;
+ fTwin=3000;
+ fTclose=3000;
+ fGeo.assign(3*IceVeto::kNdomIndex,0);
+ fGeoSet.assign(IceVeto::kNdomIndex,0);
+ SetVeto(veto);
+}
+///////////////////////////////////////////////////////////////////////////
+IceVetoStream::~IceVetoStream()
+{
+// Default destructor.
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVetoStream::SetVeto(IceVeto* veto)
+{
+// Specify the IceVeto processor that defines the veto systems (see IceVeto::DefineVetoSystem).
+// This will also start a new hit stream (see Reset).
+
+ fVeto=veto;
+ Reset();
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVetoStream::SetStartWindow(Double_t thres,Double_t twin,Double_t tclose)
+{
+// Set the minimal signal threshold "thres" and the time window size "twin" (in ns) to determine
+// the event start time, and the time "tclose" (in ns) after the event start at
+// which the hit stream is closed.
+// The actual signal threshold is 5% of the total amplitude of the processed reference hits,
+// with a minimum of "thres", in the same way as the event start time of IceVeto.
+//
+// The default values are thres=3, twin=3000 and tclose=3000.
+
+ fThres=thres;
+ fTwin=twin;
+ fTclose=tclose;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVetoStream::Reset()
+{
+// Start a new hit stream, using the current veto systems of the IceVeto processor.
+// The provided DOM positions are kept.
+
+ fStatus=0;
+ fLevel=0;
+ fNhits=0;
+ fStarted=0;
+ fTstart=0;
+ for (Int_t iref=0; iref<2; iref++)
+ {
+  fRefW[iref]=0;
+  fRefT[iref]=0;
+  fT0[iref]=0;
+  for (Int_t i=0; i<3; i++)
   {
-   vdom=dveto->GetHit(ivdom);
-   if (!vdom) continue;
+   fRefX[iref][i]=0;
+   fX0[iref][i]=0;
+  }
+ }
+ fNwin=0;
+ fWsum=0;
+ fWfirst=0;
+ fWtime.clear();
+ fWamp.clear();
+ fPindex.clear();
+ fPle.clear();
+ fPadc.clear();
+ fPslc.clear();
+ fSys.clear();
+ fSeen.clear();
+
+ if (!fVeto) return;
+
+ if (!fVeto->IsCompiled()) fVeto->CompileVetoSystems();
+
+ Int_t nvetos=0;
+ if (fVeto->fVetos) nvetos=fVeto->fVetos->GetEntries();
+ if (nvetos>Int_t(fVeto->fConfigs.size())) nvetos=fVeto->fConfigs.size();
+
+ fSys.resize(nvetos);
+ fSeen.assign(nvetos*IceVeto::kNwords,0);
+
+ IceVetoSys* vsys=0;
+ for (Int_t isys=0; isys<nvetos; isys++)
+ {
+  vsys=&fSys[isys];
+  vsys->fCfg=0;
+  vsys->fRef=0;
+  vsys->fIref=0;
+  vsys->fActive=0;
+  vsys->fParams=0;
+  vsys->fQtot=0;
+  vsys->fNdom=0;
+  vsys->fNhit=0;
+  vsys->fVetoHit=0;
+  vsys->fDone=0;
+  vsys->fRegion=0;
+  vsys->fStop=-1;
+
+  vsys->fCfg=GetConfig(isys);
+  if (!vsys->fCfg) continue;
+
+  vsys->fActive=1;
+  if (vsys->fCfg->fTresMin<=vsys->fCfg->fTresMax) fNwin++;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::AddHit(Int_t domid,Double_t le,Float_t adc,Int_t slc,const Double_t* pos)
+{
+// Process the hit with calibrated time "le" (in ns) and amplitude "adc"
+// of the DOM with ID "domid" (i.e. id=100*string+dom).
+// The flag "slc" indicates whether the hit is an SLC hit (1) or not (0).
+// Optionally the cartesian coordinates "pos" (in m) of the DOM may be provided,
+// which are needed only for veto systems with a time residual window.
+// The provided positions are kept, so they need to be provided only once for each DOM.
+//
+// The return argument is the overall veto level in case the veto decision
+// is available, and -1 otherwise.
+
+ if (fStatus) return fLevel;
+
+ if (!fVeto) return -1;
 
-   domid=vdom->GetUniqueID();
+ // Make sure that the compiled veto systems are up to date
+ if (!fVeto->IsCompiled()) fVeto->CompileVetoSystems();
 
-   // Check if the corresponding veto DOM fired in the event 
-   omx=evt->GetIdDevice(domid,"IceGOM");
-   if (!omx) continue;
+ Int_t index=IceVeto::GetDOMIndex(domid);
 
-   rx=omx->GetPosition();
-   dist0=rx.GetDistance(r0);
-   diststart=rx.GetDistance(rstart);
-   dz0=rx.GetX(3,"car")-r0.GetX(3,"car");
-   dzstart=rx.GetX(3,"car")-rstart.GetX(3,"car");
+ if (pos && index>=0)
+ {
+  for (Int_t i=0; i<3; i++)
+  {
+   fGeo[3*index+i]=pos[i];
+  }
+  fGeoSet[index]=1;
+ }
 
-   // Loop over all the recorded hits of this fired veto DOM
-   vetohit=0;
-   for (Int_t ih=1; ih<=omx->GetNhits(); ih++)
+ // Close the hit stream at the first hit beyond the closing time
+ if (fStarted && le>(fTstart+fTclose)) return Close();
+
+ fNhits++;
+
+ if (index<0) return -1;
+
+ // Accumulate the reference quantities and update the event start time window with the non-SLC InIce hits
+ Int_t jdom=abs(domid)%100;
+ Int_t jstring=abs(domid)/100;
+ if (domid>0 && jdom<=60 && !slc)
+ {
+  for (Int_t iref=0; iref<2; iref++)
+  {
+   if (!iref && jstring>78) continue; // Only the standard IceCube strings for the IceICDOM hits
+   fRefW[iref]+=adc;
+   fRefT[iref]+=adc*le;
+   for (Int_t i=0; i<3; i++)
    {
-    sx=omx->GetHit(ih);
-    if (!sx) continue;
+    fRefX[iref][i]+=adc*fGeo[3*index+i];
+   }
+  }
+
+  if (!fStarted)
+  {
+   fWtime.push_back(le);
+   fWamp.push_back(adc);
+   fWsum+=adc;
 
-    if (!slc && sx->GetSignal("SLC")) continue;
+   // Remove the hits of the start windows that didn't reach the threshold
+   while ((le-fWtime[fWfirst])>fTwin)
+   {
+    fWsum-=fWamp[fWfirst];
+    fWfirst++;
+   }
 
-    amp=sx->GetSignal("ADC",8);
-    if (amp<ampmin) continue;
+   // The signal threshold as used by IceVeto for the event start time
+   Double_t thres=0.05*fRefW[1];
+   if (thres<fThres) thres=fThres;
 
-    tx=sx->GetSignal("LE",8);
-    dt0=tx-t0;
-    dtstart=tx-tstart;
-    tres0=dt0-(dist0/c);
-    trestart=dtstart-(diststart/c);
-    tresz0=dt0-(dz0/c);
-    treszstart=dt0-(dzstart/c);
-    if (tresmin<=tresmax && (tres0<tresmin || tres0>tresmax)) continue;
-cout << " @@@ t0:" << t0 << " tstart:" << tstart << " tx:" << tx << " tx-t0:" << dt0 << " tx-tstart:" << dtstart << endl;
-cout << " dist0:" << dist0 << " (dist0/c):" << (dist0/c) << " tres0:" << tres0 << endl;
-cout << " diststart:" << diststart << " (diststart/c):" << (diststart/c) << " trestart:" << trestart << endl;
-cout << " dz0:" << dz0 << " (dz0/c):" << (dz0/c) << " tresz0:" << tresz0 << endl;
-cout << " dzstart:" << dzstart << " (dzstart/c):" << (dzstart/c) << " treszstart:" << treszstart << endl;
+   if (fWsum>=thres)
+   {
+    fStarted=1;
+    fTstart=fWtime[fWfirst];
+    fWtime.clear();
+    fWamp.clear();
+    fWfirst=0;
+   }
+   else if (fWfirst>=64 && 2*fWfirst>=Int_t(fWtime.size()))
+   {
+    // Only keep the hits of the current start time window
+    fWtime.erase(fWtime.begin(),fWtime.begin()+fWfirst);
+    fWamp.erase(fWamp.begin(),fWamp.begin()+fWfirst);
+    fWfirst=0;
+   }
+  }
+ }
 
-    // Valid veto hit encountered
-    vetohit=1;
-    qtot+=amp;
-    nhit++; 
-    params->AddHit(sx);
-   } // End of loop over the hits of this veto DOM
+ if (((fVeto->fAnyMask[index/IceVeto::kMaxDOM]>>(index%IceVeto::kMaxDOM))&1))
+ {
+  TestHit(index,le,adc,slc,0);
 
-   if (vetohit) ndom++;   
-  } // End of loop over the veto DOMs of this system
-  
-  if (qtot>=qtotmin && ndom>=ndommin && nhit>=nhitmin)
+  // Keep the hit for the veto systems with a time residual window until the hit stream is closed
+  if (fNwin)
   {
-   lveto=1;
-   vetolevel+=1;
+   fPindex.push_back(index);
+   fPle.push_back(le);
+   fPadc.push_back(adc);
+   fPslc.push_back(slc);
   }
+ }
 
-  // Add values of observables and veto level to the parameters of this veto system
-  params->SetSignal(slc,"SLCVeto");
-  params->SetSignal(ampmin,"AmpVetoMin");
-  params->SetSignal(ndommin,"NdomVetoMin");
-  params->SetSignal(nhitmin,"NhitVetoMin");
-  params->SetSignal(qtotmin,"QtotVetoMin");
-  params->SetSignal(tresmin,"TresVetoMin");
-  params->SetSignal(tresmax,"TresVetoMax");
-  params->SetSignal(ndom,"NdomVeto");
-  params->SetSignal(nhit,"NhitVeto");
-  params->SetSignal(qtot,"QtotVeto");
-  params->SetSignal(lveto,"VetoLevel");
- } // End of loop over the various veto systems
+ Decide();
 
- // Enter the final overall veto level into the event structure
- dum.StoreVetoLevel(evt,vetolevel);
+ if (fStatus) return fLevel;
+
+ return -1;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::AddHits(Int_t n,const Int_t* domid,const Double_t* le,const Float_t* adc,const Int_t* slc)
+{
+// Process a batch of "n" hits, as specified by the arrays of DOM IDs, calibrated times
+// and amplitudes and (optionally) SLC flags (see AddHit).
+// The processing stops as soon as the veto decision is available.
+//
+// The return argument is the overall veto level in case the veto decision
+// is available, and -1 otherwise.
+
+ if (!domid || !le || !adc) return -1;
+
+ Int_t level=-1;
+ Int_t flag=0;
+ for (Int_t i=0; i<n; i++)
+ {
+  flag=0;
+  if (slc) flag=slc[i];
+  level=AddHit(domid[i],le[i],adc[i],flag);
+  if (level>=0) break;
+ }
+
+ return level;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVetoStream::TestHit(Int_t index,Double_t le,Float_t adc,Int_t slc,Int_t window)
+{
+// Test the hit of the DOM with lookup table index "index" against the criteria of
+// the veto systems with (window=1) or without (window=0) a time residual window,
+// and update the accumulators of the veto systems for a valid veto hit.
+
+ Double_t c=fVeto->fSpeedC;
+
+ IceVetoSys* vsys=0;
+ const IceVetoConfig* cfg=0;
+ Double_t dist=0;
+ Double_t dx=0;
+ Double_t tres=0;
+ Int_t iref=0;
+ Int_t iw=index/IceVeto::kMaxDOM;
+ ULong64_t bit=1;
+ bit=bit<<(index%IceVeto::kMaxDOM);
+ for (Int_t isys=0; isys<Int_t(fSys.size()); isys++)
+ {
+  vsys=&fSys[isys];
+  if (!vsys->fActive || vsys->fDone) continue;
+
+  cfg=GetConfig(isys);
+  vsys->fCfg=cfg;
+  if (!cfg) continue;
+
+  if ((cfg->fTresMin<=cfg->fTresMax)!=(window!=0)) continue;
+
+  if (!fVeto->IsVetoDOM(isys,index)) continue;
+
+  if (!cfg->fSLC && slc) continue;
+
+  if (adc<cfg->fAmpMin) continue;
+
+  if (window)
+  {
+   if (!fGeoSet[index]) continue;
+
+   // The reference quantities of the hit class of this veto system
+   iref=(cfg->fHitClass=="IceICDOM") ? 0 : 1;
+   dist=0;
+   for (Int_t i=0; i<3; i++)
+   {
+    dx=fGeo[3*index+i]-fX0[iref][i];
+    dist+=dx*dx;
+   }
+   tres=(le-fT0[iref])-(sqrt(dist)/c);
+   if (tres<cfg->fTresMin || tres>cfg->fTresMax) continue;
+  }
+
+  // Valid veto hit encountered
+  vsys->fQtot+=adc;
+  vsys->fNhit++;
+  if (!(fSeen[isys*IceVeto::kNwords+iw]&bit))
+  {
+   fSeen[isys*IceVeto::kNwords+iw]|=bit;
+   vsys->fNdom++;
+  }
+
+  // Stop the evaluation of this veto system when the veto criteria are met
+  if (fVeto->IsVetoed(vsys)) vsys->fDone=1;
+ }
+}
+///////////////////////////////////////////////////////////////////////////
+const IceVetoConfig* IceVetoStream::GetConfig(Int_t isys)
+{
+// Provide the compiled parameters of the veto system with array index "isys"
+// from the current state of the IceVeto processor.
+// The compiled parameters are obtained for each access, so that no references to the
+// compiled parameters are kept, which would become invalid in case the veto systems
+// of the IceVeto processor are re-compiled.
+//
+// In case the veto system doesn't exist (anymore), a value 0 is returned.
+
+ if (!fVeto || !fVeto->fVetos) return 0;
+
+ if (isys<0 || isys>=Int_t(fVeto->fConfigs.size()) || isys>=fVeto->fVetos->GetEntries()) return 0;
+
+ if (!fVeto->fVetos->At(isys)) return 0;
+
+ return &fVeto->fConfigs[isys];
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVetoStream::Decide()
+{
+// Update the overall veto level and emit the veto decision as soon as
+// one of the veto systems meets its veto criteria.
+
+ fLevel=0;
+ for (Int_t isys=0; isys<Int_t(fSys.size()); isys++)
+ {
+  if (fSys[isys].fDone) fLevel++;
+ }
+
+ if (fLevel) fStatus=1;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::Close()
+{
+// Close the hit stream, which provides the final veto decision.
+// The kept veto DOM hits are tested against the veto systems with a time residual window,
+// using the central hit time and center of gravity of all the processed reference hits.
+//
+// The return argument is the (final) overall veto level.
+
+ if (fStatus) return fLevel;
+
+ // The central hit times and centers of gravity of the reference hits
+ for (Int_t iref=0; iref<2; iref++)
+ {
+  fT0[iref]=0;
+  for (Int_t i=0; i<3; i++)
+  {
+   fX0[iref][i]=0;
+  }
+  if (fRefW[iref]<=0) continue;
+  fT0[iref]=fRefT[iref]/fRefW[iref];
+  for (Int_t i=0; i<3; i++)
+  {
+   fX0[iref][i]=fRefX[iref][i]/fRefW[iref];
+  }
+ }
+
+ for (Int_t i=0; i<Int_t(fPindex.size()); i++)
+ {
+  TestHit(fPindex[i],fPle[i],fPadc[i],fPslc[i],1);
+ }
+ fPindex.clear();
+ fPle.clear();
+ fPadc.clear();
+ fPslc.clear();
+
+ Decide();
+ fStatus=2;
+
+ return fLevel;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::GetStatus() const
+{
+// Provide the status of the veto decision.
+//
+// 0 : The veto decision is not yet available
+// 1 : The event was vetoed, since one of the veto systems met its veto criteria
+// 2 : The hit stream was closed, and the veto level is final
+
+ return fStatus;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::GetVetoLevel() const
+{
+// Provide the current overall veto level, i.e. the number of veto systems
+// that met their veto criteria for the processed hits.
+
+ return fLevel;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::GetVetoLevel(TString name) const
+{
+// Provide the current veto level of the veto system with the specified name.
+//
+// In case the veto system is not active, a value -1 is returned.
+
+ if (!fVeto) return -1;
+
+ Int_t isys=fVeto->GetVetoIndex(name);
+ if (isys<0 || isys>=Int_t(fSys.size()) || !fSys[isys].fActive) return -1;
+
+ return fSys[isys].fDone;
+}
+///////////////////////////////////////////////////////////////////////////
+Double_t IceVetoStream::GetStartTime() const
+{
+// Provide the event start time of the hit stream.
+// In case the event start was not yet established, a value 0 is returned.
+
+ return fTstart;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t IceVetoStream::GetNhits() const
+{
+// Provide the number of processed hits of the current hit stream.
+
+ return fNhits;
+}
+///////////////////////////////////////////////////////////////////////////
+void IceVetoStream::Data() const
+{
+// Provide the current status of the veto systems for the processed hits.
+
+ cout << " *IceVetoStream::Data* Hits processed : " << fNhits << " Status : " << fStatus
+      << " Veto level : " << fLevel << endl;
+ if (fStarted)
+ {
+  cout << " Event start time : " << fTstart << " ns" << endl;
+ }
+ else
+ {
+  cout << " Event start time not yet established" << endl;
+ }
+ if (fPindex.size())
+ {
+  cout << " Veto hits awaiting the closing of the hit stream : " << fPindex.size() << endl;
+ }
+
+ if (!fVeto || !fVeto->fVetos) return;
+
+ TObject* obj=0;
+ const IceVetoSys* vsys=0;
+ for (Int_t isys=0; isys<Int_t(fSys.size()); isys++)
+ {
+  vsys=&fSys[isys];
+  if (!vsys->fActive) continue;
+  obj=fVeto->fVetos->At(isys);
+  if (!obj) continue;
+  cout << " " << obj->GetName() << " : Qtot=" << vsys->fQtot << " Nhit=" << vsys->fNhit
+       << " Ndom=" << vsys->fNdom << " Vetoed=" << vsys->fDone << endl;
+ }
 }
 ///////////////////////////////////////////////////////////////////////////
@@ -6,6 +6,8 @@
 
 // $Id$
 
+#include <vector>
+
 #include "TTask.h"
 
 #include "NcVeto.h"
@@ -14,6 +16,115 @@
 #include "NcJob.h"
 #include "NcAstrolab.h"
 
+struct IceVetoRef // Event reference quantities for a certain hit selection
+{
+ TString fClass;     // Name of the hit class (e.g. "IceIDOM")
+ Int_t fSLC;         // SLC selection mode as used in NcEvent::GetHits()
+ TObjArray fHits;    // The selected hits
+ TObjArray fOrdered; // The selected hits ordered with increasing hit time
+ NcPosition fR0;     // Reference position (COG) of the event
+ Double_t fT0;       // Reference time (central hit time) of the event
+ Double_t fQtot;     // Total signal amplitude of the selected hits
+ Int_t fNdom;        // Number of DOMs with selected hits
+ Double_t fTstart;   // Start time of the event
+ Double_t fXstart[3]; // Cartesian coordinates of the DOM of the start signal of the event
+ Double_t fX0[3];    // Cartesian coordinates of fR0
+ Int_t fI1;          // Index of the first hit of the start window in fOrdered
+ Int_t fI2;          // Index of the last hit of the start window in fOrdered
+};
+
+struct IceVetoConfig // Compiled parameters of a veto system
+{
+ TString fHitClass; // Name of the hit class to determine the reference quantities
+ Float_t fQtotMin;  // Minimal required total signal amplitude
+ Float_t fAmpMin;   // Minimal single hit amplitude required for a veto hit
+ Int_t fNdomMin;    // Minimal number of different DOMs with a veto hit
+ Int_t fNhitMin;    // Minimal total number of veto hits
+ Int_t fSLC;        // Flag to allow SLC hits as veto hits (1) or not (0)
+ Float_t fTresMin;  // Minimal time residual (in ns) required for a veto hit
+ Float_t fTresMax;  // Maximal time residual (in ns) required for a veto hit
+ Int_t fNvdoms;     // The number of veto DOMs
+};
+
+struct IceVetoSys // Evaluation status of a veto system for the current event
+{
+ const IceVetoConfig* fCfg; // The compiled parameters of this veto system
+ IceVetoRef* fRef;  // The reference quantities used by this veto system
+ Int_t fIref;       // The index of the reference quantities in the cache
+ Int_t fActive;     // Flag to indicate that this veto system is to be evaluated
+ NcVeto* fParams;   // The output device of this veto system in the event
+ Float_t fQtot;     // The accumulated total signal amplitude of the veto hits
+ Int_t fNdom;       // The accumulated number of DOMs with a veto hit
+ Int_t fNhit;       // The accumulated number of veto hits
+ Int_t fVetoHit;    // Flag to indicate a valid veto hit in the current DOM
+ Int_t fDone;       // Flag to indicate that the evaluation was stopped since the veto criteria were met
+ Int_t fRegion;     // Flag to indicate that this veto system was evaluated via the region summary
+ Int_t fStop;       // The hit index at which the evaluation was stopped (-1=not stopped)
+};
+
+struct IceVetoSysResult // The veto result of a single veto system for an event
+{
+ Int_t fStatus;     // 1=evaluated, -1=not evaluated ("any veto" policy), 0=no result available
+ Int_t fNdom;       // The number of DOMs with a veto hit
+ Int_t fNhit;       // The number of veto hits
+ Float_t fQtot;     // The total signal amplitude of the veto hits
+ Float_t fLevel;    // The veto level of this veto system
+ Int_t fLowerBound; // Flag to indicate that the observables are lower bounds
+};
+
+struct IceVetoResult // The veto result of an event
+{
+ Float_t fVetoLevel;                 // The overall veto level
+ std::vector<IceVetoSysResult> fSys; // The results of the individual veto systems
+ std::vector<NcSignal*> fHits;       // The recorded veto hits (not owned)
+ std::vector<Int_t> fHitSys;         // The veto system index of each recorded veto hit
+ Int_t fGated;                       // Flag to indicate that the event was rejected by the pre-veto gate
+ Float_t fGateQtot;                  // The total signal amplitude of the pre-veto gate hits
+ Int_t fGateNdom;                    // The number of DOMs with a signal of the pre-veto gate hits
+};
+
+struct IceVetoRect // A rectangular region of veto DOMs in the (string,DOM) plane
+{
+ Int_t fRow1; // The first row (string) in the DOM lookup table
+ Int_t fRow2; // The last row (string) in the DOM lookup table
+ Int_t fDom1; // The first DOM number
+ Int_t fDom2; // The last DOM number
+};
+
+struct IceVetoStats // Instrumentation counters of a veto system or processing stage
+{
+ Long64_t fEvents;   // The number of evaluated events
+ Double_t fTime;     // The cumulative processing time (in ns)
+ Long64_t fDoms;     // The number of visited fired (veto) DOMs
+ Long64_t fHits;     // The number of tested hits
+ Long64_t fRejSLC;   // The number of hits rejected by the SLC criterion
+ Long64_t fRejAmp;   // The number of hits rejected by the amplitude criterion
+ Long64_t fRejTres;  // The number of hits rejected by the time residual criterion
+ Long64_t fVetoHits; // The number of accepted veto hits
+ Long64_t fEarly;    // The number of early exits
+ Long64_t fRegions;  // The number of evaluations via the region summary
+};
+
+struct IceVetoScanPoint // A veto configuration of a threshold scan
+{
+ Int_t fSys;        // The array index of the veto system
+ Float_t fQtotMin;  // Minimal required total signal amplitude
+ Float_t fAmpMin;   // Minimal single hit amplitude required for a veto hit
+ Int_t fNdomMin;    // Minimal number of different DOMs with a veto hit
+ Int_t fNhitMin;    // Minimal total number of veto hits
+ Float_t fTresMin;  // Minimal time residual (in ns) required for a veto hit
+ Float_t fTresMax;  // Maximal time residual (in ns) required for a veto hit
+ Long64_t fNpass;   // The number of events that are not vetoed with this configuration
+ Long64_t fNeval;   // The number of events that were evaluated with this configuration
+};
+
+struct IceVetoScratch; // Work space for the evaluation of an event
+struct IceVetoPool;    // Registration of the per-thread work spaces
+class IceVetoStream;   // Incremental veto evaluation of time ordered hits
+class TChain;
+class TTree;
+class THashList;
+
 class IceVeto : public TTask
 {
  public :
@@ -23,14 +134,305 @@ class IceVeto : public TTask
   void DefineVetoSystem(TString name,Float_t qtot,Float_t amp,Int_t ndom,Int_t nhit,Int_t slc,Float_t tresmin,Float_t tresmax);  // Define a veto system
   void AddVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,Int_t udom); // Specify the veto doms to be added to the veto system "name"
   void RemoveVetoDOMs(TString name,Int_t lstring,Int_t ustring,Int_t ldom,Int_t udom); // Specify the veto doms to be removed from the veto system "name"
+  Int_t LoadVetoDOMs(TString name,TString file,TString cache=""); // Add the veto DOMs listed in a file to the veto system "name"
+  Int_t CheckBuiltinMasks(TString file="HESE-veto-DOMs.txt"); // Check the compile time masks of the pre-defined veto systems
   void ActivateVetoSystem(TString name,Float_t qtot=-1,Float_t amp=-1,Int_t ndom=-1,Int_t nhit=-1,Int_t slc=-1,Float_t tresmin=0,Float_t tresmax=0);  // Activate a pre-defined veto system
   void SetVetoParameter(TString sname,TString pname,Double_t pval); // Set c.q. modify a parameter of the specified veto system.
   void Data(Int_t mode=0);                              // Provide info on the registered veto procedures
   NcVeto* GetVetoSystem(TString name);                  // Provide a pointer to the specified veto system
+  NcVeto* GetVetoSystem(Int_t id);                      // Provide a pointer to the veto system with the specified ID
+  Int_t GetVetoSystemId(TString name);                  // Provide the ID of the specified veto system
+  void SetFusedEvaluation(Int_t flag);                  // Select (flag=1) the single pass evaluation of all veto systems
+  void SetRecordMode(Int_t mode);                       // Select the way the veto hits are recorded in the output devices
+  void SetVerbose(Int_t level);                         // Set the verbosity level of the event processing
+  void SetDecisionOnly(Int_t flag);                     // Select (flag=1) to stop the evaluation of a veto system once it vetoes
+  void SetAnyVeto(Int_t flag);                          // Select (flag=1) to stop the evaluation at the first vetoing veto system
+  void SetRegionEvaluation(Int_t flag,Int_t nfired=64); // Select (flag=1) the evaluation via the (string,DOM) region summary
+  void SetPreGate(Float_t qtot,Int_t ndom,TString hitclass="IceIDOM"); // Set the minimal event charge and number of DOMs to evaluate an event
+  void SetInstrumentation(Int_t flag);                  // Select (flag=1) the recording of timing and counter statistics
+  void ResetStats();                                    // Reset the timing and counter statistics
+  void GetStats(std::vector<IceVetoStats>& sys,IceVetoStats* stages) const; // Provide the merged timing and counter statistics
+  IceVetoScratch* CreateScratch() const;                // Create a work space to be used by a single (worker) thread
+  void ReleaseScratch(IceVetoScratch* scratch) const;   // Delete a work space obtained via CreateScratch()
+  NcDevice* CreateStatsDevice() const;                  // Provide the timing and counter statistics as an NcDevice
+  static Int_t GetDOMIndex(Int_t domid);                // Provide the DOM lookup table index for the specified DOM ID
+  void CompileVetoSystems();                            // (Re)build the compiled form of all veto systems
+  Int_t Evaluate(IceEvent* evt,IceVetoResult& res) const; // Thread safe evaluation of the veto systems for an event
+  Int_t Evaluate(IceEvent* evt,IceVetoResult& res,IceVetoScratch* scratch) const; // Idem with a user provided work space
+  IceVetoScratch* GetScratch() const;                   // Provide the work space owned by this IceVeto for the current thread
+  void ResetGeometry();                                 // Reset the DOM geometry tables of the work spaces
+  void StoreResult(IceEvent* evt,IceVetoResult& res,IceVetoScratch* scratch) const; // Store the veto result in the event
+  Long64_t ProcessMT(TChain* data,Int_t nthreads=0,Long64_t* naccept=0,std::vector<Float_t>* levels=0); // Multi-threaded veto evaluation of all events of a TChain
+  Long64_t ProcessBatch(TChain* data,Long64_t first,Long64_t nevt,std::vector<Float_t>* levels=0,Long64_t* naccept=0); // Veto evaluation of a range of TChain entries
+  Int_t ProcessBatch(IceEvent** evts,Int_t nevt,std::vector<Float_t>* levels=0,Int_t store=0); // Veto evaluation of an array of events
+  Long64_t ProcessPipeline(TChain* data,Int_t nworkers=0,Int_t depth=16,TTree* output=0,Long64_t* naccept=0); // Pipelined reading, veto evaluation and writing of events
+  static Int_t SetMinimalRead(TChain* data,Long64_t cachesize=30000000); // Restrict the reading of "data" to what is needed for the vetoing
+  Int_t AddScanPoint(TString name,Float_t qtot,Float_t amp,Int_t ndom,Int_t nhit,Float_t tresmin,Float_t tresmax); // Add a threshold scan configuration
+  Int_t AddScanGrid(TString name,const std::vector<Float_t>& qtot,const std::vector<Float_t>& amp,const std::vector<Int_t>& ndom,
+                    const std::vector<Int_t>& nhit,const std::vector<Float_t>& tresmin,const std::vector<Float_t>& tresmax); // Add a grid of threshold scan configurations
+  void ResetScan(Int_t mode=0);                         // Reset the threshold scan counters (mode=0) or remove all scan configurations (mode=1)
+  void ListScan() const;                                // Print the pass fraction table of the threshold scan
+  Int_t GetNscanPoints() const;                         // Provide the number of threshold scan configurations
+  Long64_t GetScanEvents() const;                       // Provide the number of events used in the threshold scan
+  Double_t GetScanFraction(Int_t ipoint) const;         // Provide the pass fraction of a threshold scan configuration
+  TTree* CreateResultTree(TString name="IceVeto",TString title="IceVeto results"); // Create a flat output tree of the veto results
+
+  enum {kMaxRefs=4};   // Maximum number of different hit selections per event
+  enum {kMaxString=86,kMaxDOM=64,kNdomIndex=(2*kMaxString+1)*kMaxDOM}; // Dimensions of the DOM lookup table
+  enum {kNwords=2*kMaxString+1}; // Number of 64-bit words (one per string) of a compiled veto DOM mask
+  enum {kStageIndex=0,kStageReference,kStageVeto,kStageOutput,kNstages}; // The instrumented processing stages
+  enum {kRecordCopy=0,kRecordRef,kRecordCount}; // The record modes of the veto hits (see SetRecordMode)
 
  protected :
   TObjArray* fVetos;   // Array with devices that contain the various veto definitions
+  Int_t fFused;        // Flag to indicate the single pass evaluation of all veto systems
+  Int_t fRecord;       // The mode for recording the veto hits in the output devices
+  Int_t fVerbose;      // The verbosity level of the event processing
+  Int_t fDecision;     // Flag to indicate that the evaluation of a veto system stops once it vetoes
+  Int_t fAnyVeto;      // Flag to indicate that the evaluation stops at the first vetoing veto system
+  Int_t fRegion;       // Flag to indicate the evaluation via the (string,DOM) region summary
+  Int_t fRegionMin;    // The minimal number of fired DOMs for the evaluation via the region summary
+  Float_t fGateQtot;   // The minimal total signal amplitude of the pre-veto gate
+  Int_t fGateNdom;     // The minimal number of DOMs with a signal of the pre-veto gate
+  TString fGateClass;  // The hit class of the pre-veto gate
+  Int_t fInstrument;   // Flag to indicate the recording of timing and counter statistics
+  Double_t fSpeedC;    //! The speed of light in vacuum in m/ns
+  IceVetoScratch* fScratch;      //! The work space for the event processing via Exec()
+  IceVetoResult fResult;         //! The veto result of the current event processed via Exec()
+  friend struct IceVetoThreadScratches; // Release of the per-thread work spaces at thread exit
+  IceVetoPool* fPool;            //! The registration of the per-thread work spaces
+  Long64_t fSerial;                               //! Unique identifier of this IceVeto object for the thread local work space cache
+  mutable std::vector<IceVetoStats> fDoneStats;   //! The statistics of the veto systems from released work spaces
+  mutable IceVetoStats fDoneStages[kNstages];     //! The statistics of the processing stages from released work spaces
+  std::vector<ULong64_t> fMasks; //! The compiled veto DOM masks of all the veto systems
+  ULong64_t fAnyMask[kNwords];   //! The union of the compiled veto DOM masks of all the veto systems
+  std::vector<IceVetoConfig> fConfigs; //! The compiled parameters of all the veto systems
+  std::vector<Int_t> fOrder;     //! The order in which the veto systems are evaluated for the "any veto" policy
+  enum {kSLCVeto=0,kAmpVetoMin,kNdomVetoMin,kNhitVetoMin,kQtotVetoMin,kTresVetoMin,kTresVetoMax,
+        kNdomVeto,kNhitVeto,kQtotVeto,kVetoLevel,kLowerBound,kNslots}; // The slots of the output devices
+  NcVeto fOutput;                //! Template for the output devices with pre-defined named slots
+  NcDevice fGate;                //! The output device for the events that failed the pre-veto gate
+  TObjArray fProtos;             //! The prototypes of the output devices of all the veto systems
+  THashList* fRegistry;          //! Name index of the veto systems in fVetos
+  TTree* fTree;                  //! The (optional) flat output tree of the veto results
+  Int_t fTreeRun;                //! The run number of the output tree entry
+  Int_t fTreeEvent;              //! The event number of the output tree entry
+  Float_t fTreeLevel;            //! The overall veto level of the output tree entry
+  std::vector<Int_t> fTreeNdom;  //! The number of DOMs with a veto hit of each veto system
+  std::vector<Int_t> fTreeNhit;  //! The number of veto hits of each veto system
+  std::vector<Float_t> fTreeQtot; //! The total veto hit amplitude of each veto system
+  std::vector<Float_t> fTreeSysLevel; //! The veto level of each veto system
+  std::vector<IceVetoScanPoint> fScan; //! The configurations of the threshold scan
+  std::vector<std::vector<IceVetoRect> > fRects; //! The veto DOM regions of each veto system
+  Long64_t fScanEvents;          //! The number of events used in the threshold scan
+  Int_t fSlots[kNslots];         //! The resolved slot indices of the output devices
+
+  IceVetoScratch* GetExecScratch(); // Provide the work space for the event processing via Exec()
+  Int_t GetVetoIndex(TString name); // Provide the array index of the specified veto system in fVetos
+  void SetVetoDOM(Int_t isys,Int_t index,Int_t flag); // Set (flag=1) or reset (flag=0) a DOM in the compiled veto mask
+  Int_t AddVetoMask(Int_t isys,const ULong64_t* mask); // Add the DOMs of a compiled veto mask to a veto system
+  void GetBuiltinMask(Int_t ibuiltin,ULong64_t* mask) const; // Provide the compiled veto mask of a pre-defined veto system
+  Int_t ParseVetoDOMs(TString file,ULong64_t* mask,std::vector<Int_t>& extra) const; // Read the veto DOMs listed in a file
+  Int_t ReadMaskCache(TString cache,TString file,ULong64_t* mask) const; // Read a compiled veto mask from a binary cache file
+  void WriteMaskCache(TString cache,TString file,const ULong64_t* mask) const; // Write a compiled veto mask to a binary cache file
+  Bool_t IsVetoDOM(Int_t isys,Int_t index) const { return (fMasks[isys*kNwords+index/kMaxDOM]>>(index%kMaxDOM))&1; }
+  void UpdateAnyMask();          // Update the union of the compiled veto DOM masks
+  void CheckMasks();             // Check the consistency of the compiled veto systems
+  Bool_t IsCompiled() const;     // Indicate whether the compiled veto systems are consistent
+  void LoadConfig(Int_t isys);   // Compile the parameters of the veto system with array index "isys"
+  void UpdatePrototypes();       // Update the prototypes of the output devices
+  void OrderVetoSystems();       // Determine the evaluation order of the veto systems for the "any veto" policy
+  Bool_t IsCheaper(const IceVetoConfig& a,const IceVetoConfig& b) const; // Evaluation order criterion for the "any veto" policy
+  void IndexDOMs(IceEvent* evt,IceVetoScratch& w) const; // Build the lookup table of the fired DOMs of the event
+  void CacheHits(IceVetoScratch& w) const;              // Store the calibrated hit data of the fired DOMs
+  Int_t PassGate(IceEvent* evt,IceVetoScratch& w,IceVetoResult& res) const; // Apply the pre-veto gate to the reference quantities
+  void StoreGate(IceEvent* evt,const IceVetoResult& res); // Mark an event that failed the pre-veto gate
+  Int_t GetCachedHit(NcSignal* sx,IceVetoScratch& w) const; // Provide the position of a hit in the calibrated hit data
+  const Double_t* GetDOMPosition(Int_t index,NcDevice* omx,IceVetoScratch& w) const; // Provide the DOM position from the geometry table
+  void FlattenHits(IceVetoScratch& w) const;            // Store the hits of the fired veto DOMs in contiguous arrays
+  void BuildRegions(Int_t isys);                        // Decompose the veto DOM mask of a veto system into rectangular regions
+  Int_t GetSummary(Int_t slc,Float_t amp,IceVetoScratch& w) const; // Provide the (string,DOM) region summary of the event
+  Int_t EvaluateRegion(Int_t isys,IceVetoScratch& w) const; // Evaluate a veto system via the region summary
+  void CutHits(const IceVetoConfig* cfg,const IceVetoRef* ref,Double_t c,IceVetoScratch& w) const; // Apply the single hit veto criteria
+  Double_t LoadReferenceHits(IceVetoRef* ref,IceVetoScratch& w) const; // Copy the calibrated data of the reference hits
+  Double_t GetStartTime(IceVetoRef* ref,Double_t thres,Double_t twin,IceVetoScratch& w) const; // Determine the event start time
+  IceVetoRef* GetReference(IceEvent* evt,const TString& classname,Int_t slc,IceVetoScratch& w) const; // Provide the (cached) reference quantities
+  void EvaluateSystem(Int_t isys,Double_t c,IceVetoScratch& w,IceVetoResult& res) const; // Evaluate a single veto system
+  void EvaluateFused(Int_t nvetos,Double_t c,IceVetoScratch& w,IceVetoResult& res) const; // Evaluate all veto systems in a single pass
+  void ScanEvent(IceEvent* evt,IceVetoScratch& w); // Evaluate the threshold scan configurations for the current event
+  void FillResultTree(IceEvent* evt,Int_t eval,IceVetoResult& res); // Fill the output tree entry of an event
+  void ShowVetoHit(Int_t jhit,IceVetoRef* ref,Double_t c,IceVetoScratch& w) const; // Print the diagnostic time residuals of a veto hit
+  void ListStats() const;        // Print the timing and counter statistics
+  Bool_t IsVetoed(const IceVetoSys* vsys) const // Check whether the veto criteria are met (incl. the current DOM)
+  {
+   const IceVetoConfig* cfg=vsys->fCfg;
+   return (vsys->fQtot>=cfg->fQtotMin && (vsys->fNdom+vsys->fVetoHit)>=cfg->fNdomMin && vsys->fNhit>=cfg->fNhitMin);
+  }
+
+ friend class IceVetoStream;
+
+ ClassDef(IceVeto,2) // TTask derived class to perform (self)vetoing of events
+};
+
+class IceVetoStream : public TObject
+{
+ public :
+  IceVetoStream(IceVeto* veto=0);                       // Constructor
+  virtual ~IceVetoStream();                             // Destructor
+  void SetVeto(IceVeto* veto);                          // Specify the IceVeto processor that defines the veto systems
+  void SetStartWindow(Double_t thres=3,Double_t twin=3000,Double_t tclose=3000); // Set the start time and closing window parameters
+  void Reset();                                         // Start a new hit stream
+  Int_t AddHit(Int_t domid,Double_t le,Float_t adc,Int_t slc=0,const Double_t* pos=0); // Process a single hit
+  Int_t AddHits(Int_t n,const Int_t* domid,const Double_t* le,const Float_t* adc,const Int_t* slc=0); // Process a batch of hits
+  Int_t Close();                                        // Close the hit stream and provide the final veto level
+  Int_t GetStatus() const;                              // Provide the status of the veto decision
+  Int_t GetVetoLevel() const;                           // Provide the current overall veto level
+  Int_t GetVetoLevel(TString name) const;               // Provide the current veto level of the specified veto system
+  Double_t GetStartTime() const;                        // Provide the event start time of the hit stream
+  Int_t GetNhits() const;                               // Provide the number of processed hits
+  void Data() const;                                    // Provide the current status of the veto systems
+
+ protected :
+  IceVeto* fVeto;                        //! The IceVeto processor that defines the veto systems
+  Double_t fThres;                       //! The signal threshold to determine the event start time
+  Double_t fTwin;                        //! The time window size to determine the event start time
+  Double_t fTclose;                      //! The time after the event start at which the hit stream is closed
+  Int_t fStatus;                         //! The status of the veto decision
+  Int_t fLevel;                          //! The overall veto level
+  Int_t fNhits;                          //! The number of processed hits
+  Int_t fStarted;                        //! Flag to indicate that the event start time was found
+  Double_t fTstart;                      //! The event start time
+  Double_t fRefW[2];                     //! The accumulated amplitudes of the IceICDOM and IceIDOM reference hits
+  Double_t fRefT[2];                     //! The amplitude weighted sums of the times of the reference hits
+  Double_t fRefX[2][3];                  //! The amplitude weighted sums of the DOM positions of the reference hits
+  Double_t fT0[2];                       //! The central hit times of the reference hits at closing of the hit stream
+  Double_t fX0[2][3];                    //! The centers of gravity of the reference hits at closing of the hit stream
+  Int_t fNwin;                           //! The number of active veto systems with a time residual window
+  Double_t fWsum;                        //! The accumulated amplitude of the current start time window
+  Int_t fWfirst;                         //! The first hit of the current start time window
+  std::vector<Double_t> fWtime;          //! The times of the hits for the start time window
+  std::vector<Float_t> fWamp;            //! The amplitudes of the hits for the start time window
+  std::vector<IceVetoSys> fSys;          //! The running accumulators of each veto system
+  std::vector<ULong64_t> fSeen;          //! The DOMs with a veto hit of each veto system
+  std::vector<Int_t> fPindex;            //! The DOM lookup table indices of the hits that await the closing of the hit stream
+  std::vector<Double_t> fPle;            //! The times of the hits that await the closing of the hit stream
+  std::vector<Float_t> fPadc;            //! The amplitudes of the hits that await the closing of the hit stream
+  std::vector<Int_t> fPslc;              //! The SLC flags of the hits that await the closing of the hit stream
+  std::vector<Double_t> fGeo;            //! The DOM positions as provided with the hits (3 coordinates per DOM)
+  std::vector<UChar_t> fGeoSet;          //! Flags to indicate the provided DOM positions
+
+  void TestHit(Int_t index,Double_t le,Float_t adc,Int_t slc,Int_t window); // Test a hit against the veto systems
+  void Decide();                                        // Update the veto decision
+  const IceVetoConfig* GetConfig(Int_t isys);           // Provide the current compiled parameters of a veto system
+
+ ClassDef(IceVetoStream,1) // Incremental veto evaluation of time ordered hit streams
+};
+
+struct IceVetoScratch // Work space for the evaluation of an event, to be used by a single thread at a time
+{
+ enum {kMaxHits=10000,kMaxGOMs=6000,kMaxSystems=64}; // Initially reserved capacities
+ Int_t fNrefs;                                  // The number of reference hit selections of the current event
+ IceVetoRef fRefs[IceVeto::kMaxRefs];           // The reference quantities of the current event
+ NcDevice* fFired[IceVeto::kNdomIndex];         // Lookup table of the fired DOMs of the current event
+ Int_t fFiredIndex[IceVeto::kNdomIndex];        // The lookup table indices of the fired DOMs of the current event
+ Int_t fNfired;                                 // The number of fired DOMs in the current event
+ Int_t fCacheFirst[IceVeto::kNdomIndex];        // The position of the first hit of each fired DOM in the calibrated hit data
+ Int_t fCacheN[IceVeto::kNdomIndex];            // The number of hits of each fired DOM in the calibrated hit data
+ Int_t fNcache;                                 // The number of hits in the calibrated hit data of the current event
+ std::vector<NcSignal*> fCsig;                  // The pointers to the hits of the calibrated hit data
+ std::vector<Double_t> fCle;                    // The calibrated leading edge times of the hits
+ std::vector<Float_t> fCadc;                    // The calibrated amplitudes of the hits
+ std::vector<Int_t> fCslc;                      // The SLC flags of the hits
+ std::vector<Int_t> fCdead;                     // The dead flags of the "LE" signals of the hits
+ TObjArray fDOMs;                               // Temp. storage of the fired DOMs of the current event
+ std::vector<IceVetoSys> fSys;                  // The evaluation status of the veto systems
+ std::vector<Int_t> fMembers;                   // Temp. storage of the veto systems to which a fired DOM belongs
+ NcVeto fWork;                                  // Device to perform the hit sorting and veto level storage
+ NcPosition fR0;                                // Temp. storage of a reference position
+ NcPosition fRx;                                // Temp. storage of a DOM position
+ Double_t fGeo[IceVeto::kNdomIndex][3];         // Geometry table with the cartesian DOM coordinates
+ Char_t fGeoSet[IceVeto::kNdomIndex];           // Flags to indicate the filled entries of the geometry table
+ Double_t fXtmp[3];                             // Temp. storage of DOM coordinates outside the geometry table
+ Int_t fNhits;                                  // The number of hits of the fired veto DOMs in the arrays below
+ std::vector<Double_t> fHx;                     // The X coordinate of the DOM of each hit
+ std::vector<Double_t> fHy;                     // The Y coordinate of the DOM of each hit
+ std::vector<Double_t> fHz;                     // The Z coordinate of the DOM of each hit
+ std::vector<Double_t> fHle;                    // The calibrated leading edge time of each hit
+ std::vector<Float_t> fHadc;                    // The calibrated amplitude of each hit
+ std::vector<Int_t> fHslc;                      // The SLC flag of each hit
+ std::vector<Int_t> fHdom;                      // The DOM lookup table index of each hit
+ std::vector<NcSignal*> fHsig;                  // The pointer to each hit
+ std::vector<Int_t> fHpass;                     // The outcome of the single hit veto criteria for each hit
+ std::vector<std::pair<Double_t,Int_t> > fTimes; // The hit times and hit indices of a reference hit selection
+ std::vector<Double_t> fWeights;                // The amplitudes of the time ordered hits of a reference hit selection
+ std::vector<Double_t> fAmps;                   // The amplitudes of the hits of a reference hit selection
+ Int_t fNtimes;                                 // The number of entries in fTimes
+ Int_t fNcand;                                  // The number of candidate veto hits of the threshold scan
+ std::vector<Float_t> fSamp;                    // The amplitudes of the candidate veto hits
+ std::vector<Double_t> fStres;                  // The time residuals of the candidate veto hits
+ std::vector<Int_t> fSdom;                      // The DOM lookup table indices of the candidate veto hits
+ enum {kMaxSummaries=2,kNcols=IceVeto::kMaxDOM+1};
+ Int_t fNsum;                                   // The number of region summaries of the current event
+ Int_t fSumSLC[kMaxSummaries];                  // The SLC selection of each region summary
+ Float_t fSumAmp[kMaxSummaries];                // The minimal hit amplitude of each region summary
+ Int_t fSumNrows[kMaxSummaries];                // The number of rows (strings) with veto hits of each region summary
+ Int_t fSumRows[kMaxSummaries][IceVeto::kNwords]; // The rows with veto hits of each region summary
+ Int_t fSumSlot[kMaxSummaries][IceVeto::kNwords]; // The position of each row in fSumRows (-1 for rows without veto hits)
+ ULong64_t fSumBits[kMaxSummaries][IceVeto::kNwords]; // The DOMs with a veto hit for each position in fSumRows
+ Double_t fSumQ[kMaxSummaries][IceVeto::kNwords][kNcols]; // The prefix sums over the DOMs of the veto hit amplitudes for each position in fSumRows
+ Int_t fSumH[kMaxSummaries][IceVeto::kNwords][kNcols];    // The prefix sums over the DOMs of the number of veto hits for each position in fSumRows
+ std::vector<IceVetoStats> fStats;              // The counter statistics of the veto systems
+ IceVetoStats fStages[IceVeto::kNstages];       // The counter statistics of the processing stages
+
+ IceVetoScratch() : fNrefs(0),fNfired(0),fNcache(0),fNhits(0),fNtimes(0),fNcand(0),fNsum(0)
+ {
+  for (Int_t i=0; i<IceVeto::kNdomIndex; i++)
+  {
+   fFired[i]=0;
+   fGeoSet[i]=0;
+  }
+
+  for (Int_t i=0; i<IceVeto::kNstages; i++)
+  {
+   fStages[i]=IceVetoStats();
+  }
+
+  for (Int_t i=0; i<kMaxSummaries; i++)
+  {
+   fSumNrows[i]=0;
+   for (Int_t j=0; j<IceVeto::kNwords; j++)
+   {
+    fSumSlot[i][j]=-1;
+   }
+  }
 
- ClassDef(IceVeto,1) // TTask derived class to perform (self)vetoing of events
+  // Reserve the capacities such that no re-allocations are needed for typical events
+  for (Int_t i=0; i<IceVeto::kMaxRefs; i++)
+  {
+   fRefs[i].fHits.Expand(kMaxHits);
+   fRefs[i].fOrdered.Expand(kMaxHits);
+  }
+  fDOMs.Expand(kMaxGOMs);
+  fSys.reserve(kMaxSystems);
+  fCsig.resize(kMaxHits);
+  fCle.resize(kMaxHits);
+  fCadc.resize(kMaxHits);
+  fCslc.resize(kMaxHits);
+  fCdead.resize(kMaxHits);
+  fHx.resize(kMaxHits);
+  fHy.resize(kMaxHits);
+  fHz.resize(kMaxHits);
+  fHle.resize(kMaxHits);
+  fHadc.resize(kMaxHits);
+  fHslc.resize(kMaxHits);
+  fHdom.resize(kMaxHits);
+  fHsig.resize(kMaxHits);
+  fHpass.resize(kMaxHits);
+  fTimes.resize(kMaxHits);
+  fWeights.resize(kMaxHits);
+  fAmps.resize(kMaxHits);
+  fMembers.reserve(kMaxSystems);
+  fWork.SetHitCopy(0);
+ }
 };
 #endif
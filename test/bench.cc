@@ -0,0 +1,279 @@
+////////////////////////////////////////////////////////
+// Macro to benchmark the IceVeto processing on synthetic events.
+//
+// The events are generated with a fixed random seed via GenerateEvents()
+// of synthetic.h and contain IceGOM hits from a vertex inside the detector,
+// with a number of hits that is distributed uniformly in log(nhits)
+// between 10 (dim cascades) and 10000 (bright muons).
+// For each benchmark pass the same events are re-generated, after which
+// only the selected processing stage is timed :
+//
+// Hit collection   : NcEvent::GetHits() of the InIce hits
+// Start time       : The above followed by sorting and NcDevice::SlideWindow()
+// Veto (legacy)    : IceVeto::Evaluate() with the per veto system hit loops
+// Veto (fused)     : IceVeto::Evaluate() with the single pass evaluation
+// Output devices   : Only IceVeto::StoreResult() after the fused evaluation
+// Exec (legacy)    : The full NcJob processing with the per veto system hit loops
+// Exec (fused)     : The full NcJob processing with the single pass evaluation
+// Veto (region)    : IceVeto::Evaluate() with the single pass and region summary evaluation
+//                    in the default record mode (see IceVeto::SetRegionEvaluation)
+//
+// For each pass the number of events per second and the number of heap allocations
+// per event of the timed processing stage are reported, and the veto levels of the legacy
+// evaluation are compared with those of the fused and region summary evaluation.
+// In addition, after a warm up pass over all events, the number of heap allocations is
+// reported for another pass over the same events of IceVeto::Evaluate() in the legacy
+// and fused evaluation modes.
+// The allocations of a warm IceVeto::Evaluate() are the ones of the NCFS hit selection
+// facilities (e.g. NcEvent::GetHits), since IceVeto itself re-uses its work space.
+// The latter is verified by the allocation check of the macro check.cc.
+//
+// The heap allocations are counted via the allocation counter of synthetic.h, which is
+// only available for a standalone executable. So, for the default benchmark output the
+// IceVeto library has to be created first, after which the executable is built and run.
+// To create the library, just do ($ is prompt)
+//
+// $root -b -l
+// root [0] gSystem->Load("ncfspack"); gSystem->Load("icepack"); gROOT->LoadMacro("IceVeto.cxx+");
+//
+// after which the executable can be built and run as follows
+//
+// $g++ -O2 -o bench bench.cc ./IceVeto_cxx.so `root-config --cflags --libs` -lncfspack -licepack
+// $./bench
+//
+// in which the include and library paths for the NCFS packages have to be added
+// as appropriate for the local installation.
+// The macro can also be run within the above ROOT session via
+//
+// root [1] .x bench.cc+
+//
+// in which case the numbers of heap allocations are reported as not available.
+//
+// The return argument (i.e. the exit status of the executable) is the number of events
+// with different legacy and fused (or region summary) veto levels.
+////////////////////////////////////////////////////////
+#include <cstdlib>
+#include <vector>
+#include <iostream>
+
+#include "TStopwatch.h"
+#include "TObjArray.h"
+
+#include "NcJob.h"
+#include "IceEvent.h"
+
+#include "IceVeto.h"
+#include "synthetic.h"
+
+using namespace std;
+
+
+///////////////////////////////////////////////////////////////////////////
+Long64_t CheckAllocations(IceVeto* veto,IceEvent** evts,Int_t nevt)
+{
+// Count the number of heap allocations of IceVeto::Evaluate() for the events "evts"
+// after a warm up pass over the same events.
+// In case the allocation counter is not available, the value -1 is returned.
+
+ if (GetAllocations()<0) return -1;
+
+ IceVetoResult res;
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  veto->Evaluate(evts[ien],res);
+ }
+
+ Long64_t nalloc=0;
+ Long64_t nbefore=0;
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  nbefore=GetAllocations();
+  veto->Evaluate(evts[ien],res);
+  nalloc+=GetAllocations()-nbefore-1;
+ }
+ return nalloc;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t bench(Int_t nevt=1000,Int_t seed=4357)
+{
+// Run the benchmark with "nevt" synthetic events generated with the random seed "seed".
+// The return argument is the number of events with different legacy and fused (or region summary) veto levels.
+
+ Int_t npass=8; // The number of benchmark passes
+
+ const char* passnames[8]={"Hit collection","Start time","Veto (legacy)","Veto (fused)",
+                           "Output devices","Exec (legacy)","Exec (fused)","Veto (region)"};
+
+ // The main data processing job
+ NcJob* job=new NcJob("NcJob","Benchmark of the IceCube event vetoing");
+
+ IceVeto* veto=new IceVeto();
+ veto->ActivateVetoSystem("HESE86");
+ veto->ActivateVetoSystem("Start86");
+ veto->ActivateVetoSystem("IceTop86");
+ veto->SetRecordMode(1);
+ veto->Data();
+
+ job->Add(veto);
+
+ IceEvent** evts=new IceEvent*[nevt];
+ std::vector<Float_t> levels;
+ std::vector<Float_t> legacy;
+ TObjArray* hits=new TObjArray();
+ TObjArray* ordered=new TObjArray();
+ NcDevice scanner;
+ TStopwatch watch;
+ Int_t counter=(GetAllocations()<0) ? 0 : 1;
+ Long64_t nalloc=0;
+ Long64_t nbefore=0;
+ Long64_t ntothits=0;
+ Double_t sum=0;
+ Double_t thres=0;
+ Int_t i1=0;
+ Int_t i2=0;
+ Int_t ndiff=0;
+ Int_t npdiff=0;
+ IceVetoResult res;
+ IceVetoScratch* scratch=veto->CreateScratch();
+ for (Int_t ipass=0; ipass<npass; ipass++)
+ {
+  // Generate the synthetic events with the fixed seed
+  ntothits=GenerateEvents(evts,nevt,seed);
+
+  if (!ipass)
+  {
+   cout << endl;
+   cout << " *BENCH* Generated events : " << nevt << " with on average " << Double_t(ntothits)/Double_t(nevt) << " hits" << endl;
+   cout << endl;
+  }
+
+  if (ipass==2 || ipass==5) veto->SetFusedEvaluation(0);
+  if (ipass==3 || ipass==4 || ipass==6 || ipass==7) veto->SetFusedEvaluation(1);
+  veto->SetRegionEvaluation((ipass==7) ? 1 : 0);
+
+  // Time the selected processing stage and count its heap allocations.
+  // The single allocation of each GetAllocations() invokation is not counted.
+  watch.Reset();
+  nalloc=0;
+  if (ipass!=4 && counter) nbefore=GetAllocations();
+  if (ipass<2)
+  {
+   watch.Start();
+   for (Int_t ien=0; ien<nevt; ien++)
+   {
+    evts[ien]->GetHits("IceIDOM",hits,"SLC",-2);
+    if (ipass==0) continue;
+    scanner.SortHits("LE",1,hits,8,1,ordered);
+    sum=scanner.SumSignals("ADC",8,ordered);
+    thres=0.05*sum;
+    if (thres<3) thres=3;
+    scanner.SlideWindow(ordered,thres,3000,"LE",8,"ADC",8,&i1,&i2);
+   }
+   watch.Stop();
+  }
+  else if (ipass<4 || ipass==7)
+  {
+   watch.Start();
+   veto->ProcessBatch(evts,nevt,&levels);
+   watch.Stop();
+  }
+  else if (ipass==4)
+  {
+   // Only the output device construction is timed
+   for (Int_t ien=0; ien<nevt; ien++)
+   {
+    if (!veto->Evaluate(evts[ien],res,scratch)) continue;
+    if (counter) nbefore=GetAllocations();
+    watch.Start(kFALSE);
+    veto->StoreResult(evts[ien],res,scratch);
+    watch.Stop();
+    if (counter) nalloc+=GetAllocations()-nbefore-1;
+   }
+  }
+  else
+  {
+   watch.Start();
+   for (Int_t ien=0; ien<nevt; ien++)
+   {
+    job->ProcessObject(evts[ien]);
+   }
+   watch.Stop();
+  }
+
+  if (ipass!=4 && counter) nalloc=GetAllocations()-nbefore-1;
+
+  // Compare the veto levels of the legacy and fused evaluation
+  if (ipass==2) legacy=levels;
+  if (ipass==3 || ipass==7)
+  {
+   npdiff=0;
+   for (Int_t ien=0; ien<nevt; ien++)
+   {
+    if (levels[ien]!=legacy[ien]) npdiff++;
+   }
+   ndiff+=npdiff;
+  }
+
+  cout << " *BENCH* " << passnames[ipass] << " : " << Double_t(nevt)/watch.RealTime() << " events/s"
+       << " (" << 1.e6*watch.RealTime()/Double_t(nevt) << " us/event) heap allocations : ";
+  if (counter)
+  {
+   cout << Double_t(nalloc)/Double_t(nevt) << " per event" << endl;
+  }
+  else
+  {
+   cout << "n.a." << endl;
+  }
+  if (ipass==3) cout << " *BENCH* Events with different legacy and fused veto levels : " << npdiff << endl;
+  if (ipass==7) cout << " *BENCH* Events with different legacy and region summary veto levels : " << npdiff << endl;
+
+  for (Int_t ien=0; ien<nevt; ien++)
+  {
+   delete evts[ien];
+  }
+ }
+
+ // The heap allocations of the veto evaluation in the legacy and fused mode
+ cout << endl;
+ GenerateEvents(evts,nevt,seed);
+ for (Int_t fused=0; fused<2; fused++)
+ {
+  veto->SetFusedEvaluation(fused);
+  nalloc=CheckAllocations(veto,evts,nevt);
+  if (nalloc<0)
+  {
+   cout << " *BENCH* Allocation counter not available (only for a standalone executable)." << endl;
+   break;
+  }
+  cout << " *BENCH* Heap allocations of Evaluate() " << (fused ? "(fused)" : "(legacy)") << " over " << nevt
+       << " warm events : " << nalloc << " (" << Double_t(nalloc)/Double_t(nevt) << " per event)" << endl;
+ }
+
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  delete evts[ien];
+ }
+
+ veto->ReleaseScratch(scratch);
+ delete [] evts;
+ delete hits;
+ delete ordered;
+
+ return ndiff;
+}
+
+#if !defined(__CLING__) && !defined(__ACLIC__)
+///////////////////////////////////////////////////////////////////////////
+int main(int argc,char** argv)
+{
+// Standalone invokation of the benchmark with the allocation counter.
+// Optionally the number of events and the random seed may be provided as arguments.
+
+ Int_t nevt=1000;
+ Int_t seed=4357;
+ if (argc>1) nevt=atoi(argv[1]);
+ if (argc>2) seed=atoi(argv[2]);
+
+ return bench(nevt,seed);
+}
+#endif
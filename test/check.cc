@@ -0,0 +1,488 @@
+////////////////////////////////////////////////////////
+// Macro to check the consistency of the various IceVeto processing modes
+// on synthetic events.
+//
+// The events are generated with a fixed random seed via GenerateEvents()
+// of synthetic.h and are written into the tree "T" (branch "IceEvent")
+// of two temporary ROOT files, which are accessed via a TChain.
+// The following checks are performed :
+//
+// Veto masks     : The pre-defined veto DOM masks agree with their DOM ranges and "HESE86"
+//                  agrees with the veto DOMs listed in HESE-veto-DOMs.txt (see CheckBuiltinMasks)
+// Batch address  : The "IceEvent" branch address of the caller is kept by ProcessBatch()
+// Multi-threaded : The veto levels of ProcessMT() agree with those of ProcessBatch()
+// Pipeline       : The events written by ProcessPipeline() are the accepted events of the
+//                  sequential processing and contain the same veto results, and the
+//                  "IceEvent" branch address of the caller is kept
+// Region summary : The veto levels of the region summary evaluation (see SetRegionEvaluation)
+//                  in the default record mode agree with those of the hit scan
+// Streaming      : The veto decisions of IceVetoStream agree with those of IceVeto::Evaluate(),
+//                  also for a veto system with a time residual window
+// Allocations    : The heap allocations of Evaluate() for warm events don't exceed those
+//                  of the NCFS hit selection facilities that are invoked by Evaluate()
+//
+// For each check the number of failures is reported, and the return argument
+// is the total number of failures.
+//
+// Since the file HESE-veto-DOMs.txt is used, this macro has to be run from the IceVeto test directory.
+//
+// To run this macro, just do ($ is prompt)
+//
+// $root -b -l
+// root [0] gSystem->Load("ncfspack"); gSystem->Load("icepack"); gROOT->LoadMacro("IceVeto.cxx+");
+// root [1] .x check.cc+
+//
+// Alternatively, after the IceVeto library has been created (e.g. via the above ACLiC invokation)
+// a standalone executable can be built and run as follows
+//
+// $g++ -O2 -o check check.cc ./IceVeto_cxx.so `root-config --cflags --libs` -lncfspack -licepack
+// $./check
+//
+// in which the include and library paths for the NCFS packages have to be added
+// as appropriate for the local installation.
+// The exit status of the executable is the total number of failures.
+// A temporary ROOT file check-out.root is created for the events written by ProcessPipeline().
+// Note that the allocation check is only performed for such a standalone executable,
+// since the allocation counter of synthetic.h is not available within a ROOT session.
+////////////////////////////////////////////////////////
+#include <cstdlib>
+#include <vector>
+#include <iostream>
+
+#include "TSystem.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TChain.h"
+
+#include "IceEvent.h"
+
+#include "IceVeto.h"
+#include "synthetic.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////
+Int_t WriteEvents(const char* fname,IceEvent** evts,Int_t first,Int_t nevt)
+{
+// Write the "nevt" events of "evts" starting at index "first" into the tree "T"
+// of the ROOT file with name "fname".
+// The return argument is the number of written events.
+
+ TFile* file=new TFile(fname,"RECREATE","Synthetic IceCube events");
+ TTree* tree=new TTree("T","Synthetic IceCube events");
+
+ IceEvent* evt=0;
+ tree->Branch("IceEvent",&evt,32000,99);
+
+ Int_t nwrite=0;
+ for (Int_t ien=first; ien<first+nevt; ien++)
+ {
+  evt=evts[ien];
+  tree->SetBranchAddress("IceEvent",&evt);
+  tree->Fill();
+  nwrite++;
+ }
+
+ tree->Write();
+ file->Close();
+ delete file;
+
+ return nwrite;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t CompareLevels(const char* name,std::vector<Float_t>& levels,std::vector<Float_t>& ref)
+{
+// Compare the veto levels "levels" with the reference levels "ref" and report the result
+// of the check with name "name".
+// The return argument is the number of different veto levels.
+
+ Int_t nfail=0;
+ if (levels.size()!=ref.size()) nfail=1+Int_t(ref.size());
+ for (Int_t i=0; !nfail && i<Int_t(ref.size()); i++)
+ {
+  if (levels[i]!=ref[i]) nfail++;
+ }
+
+ cout << " *CHECK* " << name << " : " << ref.size() << " entries with " << nfail << " failure(s)" << endl;
+
+ return nfail;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t CheckBatchAddress(IceVeto* veto,TChain* data,IceEvent** evts)
+{
+// Check that the "IceEvent" branch address of the caller is kept by ProcessBatch().
+// The return argument is the number of failures.
+
+ IceEvent* user=0;
+ data->SetBranchAddress("IceEvent",&user);
+
+ veto->ProcessBatch(data,0,-1);
+
+ Int_t nfail=0;
+ Long64_t nentries=data->GetEntries();
+ for (Long64_t ient=0; ient<nentries; ient++)
+ {
+  data->GetEntry(ient);
+  if (!user || user->GetEventNumber()!=evts[ient]->GetEventNumber()) nfail++;
+ }
+
+ cout << " *CHECK* Batch address : " << nentries << " entries with " << nfail << " failure(s)" << endl;
+
+ data->ResetBranchAddresses();
+ if (user) delete user;
+
+ return nfail;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t CompareResults(IceEvent* evt,IceEvent* ref)
+{
+// Compare the "IceVeto-<system>" output devices of the event "evt" with those
+// of the reference event "ref".
+// The return argument is the number of output devices with different contents.
+
+ if (!evt || !ref) return 1;
+
+ Int_t nfail=0;
+ NcDevice* dref=0;
+ NcDevice* dev=0;
+ TString name;
+ for (Int_t idev=1; idev<=ref->GetNdevices(); idev++)
+ {
+  dref=ref->GetDevice(idev);
+  if (!dref) continue;
+
+  name=dref->GetName();
+  if (!name.BeginsWith("IceVeto-")) continue;
+
+  dev=evt->GetDevice(name);
+  if (!dev || dev->GetNslots()!=dref->GetNslots() || dev->GetNhits()!=dref->GetNhits())
+  {
+   nfail++;
+   continue;
+  }
+
+  for (Int_t j=1; j<=dref->GetNslots(); j++)
+  {
+   if (dev->GetSignal(j)!=dref->GetSignal(j))
+   {
+    nfail++;
+    break;
+   }
+  }
+ }
+
+ return nfail;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t CheckPipeline(IceVeto* veto,TChain* data,IceEvent** evts,Int_t nevt,Int_t seed)
+{
+// Check that the events written by ProcessPipeline() are the accepted events of the
+// sequential processing (see Exec) of the events generated with the random seed "seed",
+// and that these events contain the same veto results.
+// Also the "IceEvent" branch address of the caller is checked to be kept.
+// The return argument is the number of failures.
+
+ // The veto results of the sequential processing of the same events
+ IceEvent** seq=new IceEvent*[nevt];
+ GenerateEvents(seq,nevt,seed);
+ std::vector<Float_t> levels;
+ veto->ProcessBatch(seq,nevt,&levels,1);
+
+ Long64_t nseq=0;
+ for (Int_t ien=0; ien<Int_t(levels.size()); ien++)
+ {
+  if (levels[ien]>=0 && levels[ien]<0.5) nseq++;
+ }
+
+ // The pipelined processing with a writer
+ IceEvent* user=0;
+ data->SetBranchAddress("IceEvent",&user);
+
+ const char* fname="check-out.root";
+ TFile* file=new TFile(fname,"RECREATE","Accepted synthetic IceCube events");
+ TTree* output=new TTree("T","Accepted synthetic IceCube events");
+
+ Long64_t naccept=0;
+ veto->ProcessPipeline(data,2,4,output,&naccept);
+
+ Int_t nfail=0;
+ if (naccept!=nseq || output->GetEntries()!=nseq) nfail++;
+
+ // Compare the written events with the sequentially processed ones
+ IceEvent* evt=0;
+ output->SetBranchAddress("IceEvent",&evt);
+ std::vector<Int_t> written(nevt,0);
+ Int_t idx=0;
+ for (Long64_t ient=0; ient<output->GetEntries(); ient++)
+ {
+  idx=-1;
+  if (output->GetEntry(ient)>0 && evt) idx=evt->GetEventNumber()-1;
+  if (idx<0 || idx>=Int_t(levels.size()) || written[idx] || levels[idx]<0 || levels[idx]>=0.5)
+  {
+   nfail++;
+   continue;
+  }
+  written[idx]=1;
+  nfail+=CompareResults(evt,seq[idx]);
+ }
+ output->ResetBranchAddresses();
+ if (evt) delete evt;
+
+ // The branch address of the caller
+ Long64_t nentries=data->GetEntries();
+ for (Long64_t ient=0; ient<nentries; ient++)
+ {
+  data->GetEntry(ient);
+  if (!user || user->GetEventNumber()!=evts[ient]->GetEventNumber()) nfail++;
+ }
+ data->ResetBranchAddresses();
+ if (user) delete user;
+
+ cout << " *CHECK* Pipeline : " << nseq << " accepted events with " << nfail << " failure(s)" << endl;
+
+ file->Close();
+ delete file;
+ gSystem->Unlink(fname);
+
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  delete seq[ien];
+ }
+ delete [] seq;
+
+ return nfail;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t CheckStream(IceEvent** evts,Int_t nevt)
+{
+// Check that the veto decisions of the streaming evaluation via IceVetoStream agree with
+// those of IceVeto::Evaluate(), by providing all the hits of each event in time order.
+// Since IceVetoStream emits its decision as soon as one of the veto systems vetoes,
+// only the decisions (i.e. vetoed or not) are compared.
+// In addition to the veto systems without a time residual window, also a veto system
+// with a time residual window is used.
+// The return argument is the number of failures.
+
+ IceVeto* veto=new IceVeto();
+ veto->ActivateVetoSystem("HESE86");
+ veto->ActivateVetoSystem("IceTop86");
+ veto->ActivateVetoSystem("Sides86",-1,-1,-1,-1,-1,-2000,500);
+
+ IceVetoStream stream(veto);
+ stream.SetStartWindow(3,3000,1e9); // Make sure that all the hits are processed
+
+ IceVetoResult res;
+ TObjArray hits;
+ TObjArray ordered;
+ NcDevice sorter;
+ NcSignal* sx=0;
+ NcDevice* omx=0;
+ Double_t pos[3];
+ Int_t slc=0;
+ Int_t level=0;
+ Int_t nfail=0;
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  level=-1;
+  if (veto->Evaluate(evts[ien],res)) level=Int_t(res.fVetoLevel);
+
+  // Provide all the hits of the event in time order
+  stream.Reset();
+  hits.Clear();
+  ordered.Clear();
+  evts[ien]->GetHits("IceGOM",&hits);
+  sorter.SortHits("LE",1,&hits,8,1,&ordered);
+  for (Int_t ih=0; ih<ordered.GetEntries(); ih++)
+  {
+   sx=(NcSignal*)ordered.At(ih);
+   if (!sx) continue;
+   omx=sx->GetDevice();
+   if (!omx) continue;
+   omx->GetPosition(pos,"car");
+   slc=0;
+   if (sx->GetSignal("SLC")) slc=1;
+   stream.AddHit(omx->GetUniqueID(),sx->GetSignal("LE",8),sx->GetSignal("ADC",8),slc,pos);
+  }
+
+  if ((stream.Close()>0)!=(level>0)) nfail++;
+ }
+
+ cout << " *CHECK* Streaming : " << nevt << " events with " << nfail << " failure(s)" << endl;
+
+ delete veto;
+
+ return nfail;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t CheckAllocations(IceVeto* veto,IceEvent** evts,Int_t nevt)
+{
+// Check that IceVeto::Evaluate() doesn't perform heap allocations of its own for warm events,
+// i.e. that the heap allocations for an event are limited to the ones of the NCFS invokations
+// to obtain the fired DOMs and the hit selections and reference quantities of the active
+// veto systems, which use the hits of the classes IceICDOM (HESE86) and IceIDOM.
+// The return argument is the number of failures.
+
+ if (GetAllocations()<0)
+ {
+  cout << " *CHECK* Allocations : Allocation counter not available (only for a standalone executable)" << endl;
+  return 0;
+ }
+
+ const Int_t nclass=2;
+ const char* classes[nclass]={"IceICDOM","IceIDOM"};
+
+ IceVetoResult res;
+ TObjArray doms;
+ TObjArray hits[nclass];
+
+ // The warm up pass over all events, also for the NCFS invokations
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  veto->Evaluate(evts[ien],res);
+  doms.Clear();
+  evts[ien]->GetDevices("IceGOM",&doms);
+  for (Int_t i=0; i<nclass; i++)
+  {
+   hits[i].Clear();
+   evts[ien]->GetHits(classes[i],&hits[i],"SLC",-2);
+  }
+ }
+
+ Int_t nfail=0;
+ Long64_t nveto=0;
+ Long64_t nncfs=0;
+ Long64_t nalloc=0;
+ Long64_t nref=0;
+ Long64_t nbefore=0;
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  nbefore=GetAllocations();
+  veto->Evaluate(evts[ien],res);
+  nalloc=GetAllocations()-nbefore-1;
+
+  nbefore=GetAllocations();
+  doms.Clear();
+  evts[ien]->GetDevices("IceGOM",&doms);
+  for (Int_t i=0; i<nclass; i++)
+  {
+   hits[i].Clear();
+   evts[ien]->GetHits(classes[i],&hits[i],"SLC",-2);
+   evts[ien]->GetCOG(&hits[i],1,"ADC",8);
+   evts[ien]->GetCVAL(&hits[i],"LE","ADC",8);
+  }
+  nref=GetAllocations()-nbefore-1;
+
+  nveto+=nalloc;
+  nncfs+=nref;
+  if (nalloc>nref) nfail++;
+ }
+
+ cout << " *CHECK* Allocations : " << nevt << " events with " << nfail << " failure(s)"
+      << " (Evaluate : " << Double_t(nveto)/Double_t(nevt) << " per event, NCFS : "
+      << Double_t(nncfs)/Double_t(nevt) << " per event)" << endl;
+
+ return nfail;
+}
+///////////////////////////////////////////////////////////////////////////
+Int_t check(Int_t nevt=200,Int_t seed=4357)
+{
+// Run the consistency checks with "nevt" synthetic events generated with the random seed "seed".
+// The return argument is the total number of failures.
+
+ IceVeto* veto=new IceVeto();
+ veto->ActivateVetoSystem("HESE86");
+ veto->ActivateVetoSystem("Start86");
+ veto->ActivateVetoSystem("IceTop86");
+
+ // Generate the synthetic events and write them into two files
+ IceEvent** evts=new IceEvent*[nevt];
+ GenerateEvents(evts,nevt,seed);
+
+ const char* fnames[2]={"check-1.root","check-2.root"};
+ WriteEvents(fnames[0],evts,0,nevt/2);
+ WriteEvents(fnames[1],evts,nevt/2,nevt-nevt/2);
+
+ TChain* data=new TChain("T");
+ data->Add(fnames[0]);
+ data->Add(fnames[1]);
+
+ cout << endl;
+ cout << " *CHECK* Generated events : " << nevt << " in " << data->GetEntries() << " chain entries" << endl;
+ cout << endl;
+
+ Int_t nfail=0;
+
+ // The compiled veto DOM masks of the pre-defined veto systems
+ Int_t ndiff=veto->CheckBuiltinMasks("HESE-veto-DOMs.txt");
+ cout << " *CHECK* Veto masks : " << ndiff << " failure(s)" << endl;
+ nfail+=ndiff;
+
+ // The reference veto levels of the sequential processing
+ std::vector<Float_t> ref;
+ veto->ProcessBatch(data,0,-1,&ref);
+
+ nfail+=CheckBatchAddress(veto,data,evts);
+
+ // The veto levels of the multi-threaded processing
+ std::vector<Float_t> levels;
+ veto->ProcessMT(data,4,0,&levels);
+ nfail+=CompareLevels("Multi-threaded",levels,ref);
+
+ nfail+=CheckPipeline(veto,data,evts,nevt,seed);
+
+ // The veto levels of the region summary evaluation for all events
+ veto->SetRegionEvaluation(1,0);
+ veto->ProcessBatch(data,0,-1,&levels);
+ nfail+=CompareLevels("Region summary",levels,ref);
+ veto->SetRegionEvaluation(0);
+
+ nfail+=CheckStream(evts,nevt);
+
+ // The heap allocations of the veto evaluation in the legacy and fused mode
+ for (Int_t fused=0; fused<2; fused++)
+ {
+  veto->SetFusedEvaluation(fused);
+  nfail+=CheckAllocations(veto,evts,nevt);
+ }
+
+ cout << endl;
+ if (nfail)
+ {
+  cout << " *CHECK* Total number of failures : " << nfail << endl;
+ }
+ else
+ {
+  cout << " *CHECK* All checks passed." << endl;
+ }
+
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  delete evts[ien];
+ }
+ delete [] evts;
+ delete data;
+ delete veto;
+
+ for (Int_t i=0; i<2; i++)
+ {
+  gSystem->Unlink(fnames[i]);
+ }
+
+ return nfail;
+}
+
+#if !defined(__CLING__) && !defined(__ACLIC__)
+///////////////////////////////////////////////////////////////////////////
+int main(int argc,char** argv)
+{
+// Standalone invokation of the consistency checks.
+// Optionally the number of events and the random seed may be provided as arguments.
+
+ Int_t nevt=200;
+ Int_t seed=4357;
+ if (argc>1) nevt=atoi(argv[1]);
+ if (argc>2) seed=atoi(argv[2]);
+
+ return check(nevt,seed);
+}
+#endif
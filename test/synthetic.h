@@ -0,0 +1,232 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+////////////////////////////////////////////////////////
+// Generation of synthetic IceCube events for the benchmark (bench.cc)
+// and consistency check (check.cc) macros of the IceVeto processing.
+//
+// The events are generated with a fixed random seed and contain
+// IceGOM hits from a vertex inside the detector, with a number of hits
+// that is distributed uniformly in log(nhits) between 10 (dim cascades)
+// and 10000 (bright muons).
+//
+// Allocation counter :
+// --------------------
+// For a standalone executable (i.e. not compiled via ACLiC or interpreted by Cling)
+// the global operators new and delete are replaced by versions that count the number
+// of heap allocations, which is provided by GetAllocations().
+// Since a replaced operator new is only effective when it is provided by the executable
+// itself, the allocation counter is not available within a ROOT session, in which
+// case GetAllocations() returns the value -1.
+////////////////////////////////////////////////////////
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+#include "TRandom3.h"
+#include "TMath.h"
+#include "TObjArray.h"
+
+#include "IceEvent.h"
+#include "IceICDOM.h"
+#include "IceDCDOM.h"
+#include "IceTDOM.h"
+
+#if !defined(__CLING__) && !defined(__ACLIC__)
+static std::atomic<Long64_t> gSyntheticAllocs(0); // The number of performed heap allocations
+
+void* operator new(std::size_t n)
+{
+ gSyntheticAllocs++;
+ void* p=malloc(n ? n : 1);
+ if (!p) throw std::bad_alloc();
+ return p;
+}
+
+void* operator new[](std::size_t n)
+{
+ gSyntheticAllocs++;
+ void* p=malloc(n ? n : 1);
+ if (!p) throw std::bad_alloc();
+ return p;
+}
+
+void* operator new(std::size_t n,const std::nothrow_t&) noexcept
+{
+ gSyntheticAllocs++;
+ return malloc(n ? n : 1);
+}
+
+void* operator new[](std::size_t n,const std::nothrow_t&) noexcept
+{
+ gSyntheticAllocs++;
+ return malloc(n ? n : 1);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p,std::size_t) noexcept { free(p); }
+void operator delete[](void* p,std::size_t) noexcept { free(p); }
+void operator delete(void* p,const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p,const std::nothrow_t&) noexcept { free(p); }
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+inline Long64_t GetAllocations()
+{
+// Provide the number of heap allocations performed so far, including the single
+// allocation of this memberfunction itself.
+// In case the allocation counter is not available, the value -1 is returned.
+
+#if !defined(__CLING__) && !defined(__ACLIC__)
+ // Verify that the replaced operator new is the one that is actually invoked
+ Long64_t nbefore=gSyntheticAllocs;
+ void* p=::operator new(1);
+ ::operator delete(p);
+ if (gSyntheticAllocs==nbefore) return -1;
+ return gSyntheticAllocs;
+#else
+ return -1;
+#endif
+}
+///////////////////////////////////////////////////////////////////////////
+inline Long64_t GenerateEvents(IceEvent** evts,Int_t nevt,Int_t seed)
+{
+// Generate "nevt" synthetic events with the random seed "seed" and store them in "evts".
+// The return argument is the total number of generated hits.
+
+ // The (approximate) string positions of IceCube and DeepCore
+ Double_t xstring[87];
+ Double_t ystring[87];
+ for (Int_t is=1; is<=86; is++)
+ {
+  if (is<=78)
+  {
+   xstring[is]=125.*(Double_t((is-1)%10)-4.5);
+   ystring[is]=125.*(Double_t((is-1)/10)-3.5);
+  }
+  else
+  {
+   xstring[is]=60.*cos(2.*TMath::Pi()*Double_t(is-79)/8.);
+   ystring[is]=60.*sin(2.*TMath::Pi()*Double_t(is-79)/8.);
+  }
+ }
+
+ TRandom3 rndm(seed);
+ Int_t slot[87*65];
+ TObjArray doms;
+ Double_t pos[3];
+ Long64_t ntothits=0;
+ for (Int_t ien=0; ien<nevt; ien++)
+ {
+  IceEvent* evt=new IceEvent();
+  evt->SetDevCopy(1);
+  evt->SetRunNumber(1);
+  evt->SetEventNumber(ien+1);
+
+  Int_t nhits=Int_t(10.*pow(1000.,rndm.Rndm()));
+  Double_t vx=rndm.Uniform(-500,500);
+  Double_t vy=rndm.Uniform(-450,450);
+  Double_t vz=rndm.Uniform(-500,500);
+  Double_t spread=30.*pow(Double_t(nhits),1./3.);
+
+  for (Int_t i=0; i<87*65; i++)
+  {
+   slot[i]=-1;
+  }
+  doms.Clear();
+
+  for (Int_t ih=0; ih<nhits; ih++)
+  {
+   Double_t x=rndm.Gaus(vx,spread);
+   Double_t y=rndm.Gaus(vy,spread);
+   Double_t z=rndm.Gaus(vz,spread);
+
+   // The nearest string and DOM
+   Int_t jstring=1;
+   Double_t dmin=1e10;
+   for (Int_t is=1; is<=86; is++)
+   {
+    Double_t d2=pow(x-xstring[is],2)+pow(y-ystring[is],2);
+    if (d2<dmin)
+    {
+     dmin=d2;
+     jstring=is;
+    }
+   }
+   Int_t jdom=TMath::Nint((500.-z)/17.)+1;
+   Double_t zdom=500.-17.*Double_t(jdom-1);
+   if (jstring>78)
+   {
+    jdom=TMath::Nint((-150.-z)/7.)+11;
+    zdom=-150.-7.*Double_t(jdom-11);
+   }
+   if (jdom<1 || jdom>60) continue;
+
+   // Some IceTop signals for the bright events
+   if (nhits>1000 && rndm.Rndm()<0.01)
+   {
+    jdom=61+Int_t(4.*rndm.Rndm());
+    zdom=1950;
+   }
+
+   pos[0]=xstring[jstring];
+   pos[1]=ystring[jstring];
+   pos[2]=zdom;
+   Double_t dist=sqrt(pow(pos[0]-vx,2)+pow(pos[1]-vy,2)+pow(pos[2]-vz,2));
+
+   NcDevice* om=0;
+   Int_t index=jstring*65+jdom;
+   if (slot[index]<0)
+   {
+    if (jdom>60)
+    {
+     om=new IceTDOM();
+    }
+    else if (jstring>78)
+    {
+     om=new IceDCDOM();
+    }
+    else
+    {
+     om=new IceICDOM();
+    }
+    om->SetUniqueID(jstring*100+jdom);
+    om->SetPosition(pos,"car");
+    slot[index]=doms.GetEntries();
+    doms.Add(om);
+   }
+   om=(NcDevice*)doms.At(slot[index]);
+
+   NcSignal sx;
+   sx.SetSlotName("ADC",1);
+   sx.SetSlotName("LE",2);
+   sx.SetSlotName("TOT",3);
+   sx.SetSlotName("SLC",4);
+   Double_t adc=rndm.Exp(1.)*(1.+200./(dist+20.));
+   sx.SetSignal(adc,"ADC");
+   sx.SetSignal(10000.+dist/0.22+rndm.Exp(100.),"LE");
+   sx.SetSignal(50,"TOT");
+   if (adc<0.7 && rndm.Rndm()<0.5)
+   {
+    sx.SetSignal(1,"SLC");
+   }
+   else
+   {
+    sx.SetSignal(0,"SLC");
+   }
+   om->AddHit(sx);
+   ntothits++;
+  }
+
+  for (Int_t idom=0; idom<doms.GetEntries(); idom++)
+  {
+   evt->AddDevice(*doms.At(idom));
+  }
+  doms.Delete();
+
+  evts[ien]=evt;
+ }
+
+ return ntothits;
+}
+#endif
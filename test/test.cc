@@ -25,6 +25,7 @@
  veto->ActivateVetoSystem("IceTop86");
 // veto->ActivateVetoSystem("HESE86");
 // veto->ActivateVetoSystem("Start86");
+// veto->SetPreGate(6000,0); // Don't evaluate events with Qtot<6000 pe
  veto->Data(1);
 
  NcEventSelector* sel=new NcEventSelector();